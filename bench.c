@@ -0,0 +1,189 @@
+// Microbenchmarks of the update and render hot paths of the game:
+//   $ ./bench > bench.json
+//
+// game.c is included directly so its internal functions can be timed in isolation against a
+// platform that does nothing but count the calls. Every op is timed individually starting from
+// the same prepared state, which is restored (untimed) before each sample.
+//
+// NOTE: do not include stdlib.h here, game.c has its own rand()
+#include <stdio.h>
+#include <time.h>
+
+#include "game.c"
+
+static u32 draw_calls = 0;
+
+// NOTE: the platform lives in the same translation unit as the game, keep the compiler from
+// inlining it, otherwise whole render loops fold into a single counter update. A real platform is
+// always an opaque call.
+#define PLATFORM __attribute__((noinline))
+
+PLATFORM void platform_fill_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
+{
+    (void) x; (void) y; (void) w; (void) h; (void) color;
+    draw_calls += 1;
+}
+
+PLATFORM void platform_stroke_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
+{
+    (void) x; (void) y; (void) w; (void) h; (void) color;
+    draw_calls += 1;
+}
+
+PLATFORM void platform_fill_text(i32 x, i32 y, const char *text, u32 size, u32 color)
+{
+    (void) x; (void) y; (void) text; (void) size; (void) color;
+    draw_calls += 1;
+}
+
+PLATFORM u32 platform_text_width(const char *text, u32 size)
+{
+    u32 n = 0;
+    while (text[n] != '\0') n += 1;
+    return n*size/2;
+}
+
+void platform_panic(const char *file_path, i32 line, const char *message)
+{
+    fprintf(stderr, "%s:%d: GAME ASSERTION FAILED: %s\n", file_path, line, message);
+    __builtin_abort();
+}
+
+PLATFORM void platform_log(const char *message)
+{
+    (void) message;
+}
+
+PLATFORM u64 platform_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec*1000*1000*1000 + ts.tv_nsec;
+}
+
+#define BENCH_SAMPLES 2000
+
+static const u32 bench_snake_lens[] = {SNAKE_INIT_SIZE, 8, 16, 32, 64, 96, 128, SNAKE_CAP - 2};
+
+static const struct {
+    u32 width, height;
+} bench_sizes[] = {
+    {800, 450},
+    {1280, 720},
+    {1600, 900},
+    {1920, 1080},
+    {2560, 1440},
+    {3840, 2160},
+};
+
+static f64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static f64 timer_overhead = 0.0;
+
+// The snake occupies the first `len` cells of the serpentine heading for the next one, which is
+// free, and the egg sits in the very last cell of the board away from it.
+static void bench_setup(u32 width, u32 height, u32 len)
+{
+    game_restart(width, height);
+    game_snapshot_serpentine(game_snapshot_buffer(), len);
+    game_snapshot_restore(game_snapshot_buffer());
+}
+
+typedef enum {
+    OP_GAME_UPDATE_STEP,
+    OP_RANDOM_EGG,
+    OP_SNAKE_RENDER,
+    OP_BACKGROUND_RENDER,
+    OP_GAME_RENDER,
+    OP_SNAPSHOT_ROUND_TRIP,
+    COUNT_OPS,
+} Op;
+
+static const char *op_names[COUNT_OPS] = {
+    [OP_GAME_UPDATE_STEP]  = "game_update_step",
+    [OP_RANDOM_EGG]        = "random_egg",
+    [OP_SNAKE_RENDER]      = "snake_render",
+    [OP_BACKGROUND_RENDER] = "background_render",
+    [OP_GAME_RENDER]       = "game_render",
+    [OP_SNAPSHOT_ROUND_TRIP] = "snapshot_round_trip",
+};
+
+static void op_run(Op op)
+{
+    switch (op) {
+    case OP_GAME_UPDATE_STEP:  game_advance(STEP_INTEVAL); break;
+    case OP_RANDOM_EGG:        random_egg(FALSE);          break;
+    case OP_SNAKE_RENDER:      snake_render();             break;
+    case OP_BACKGROUND_RENDER: background_render();        break;
+    case OP_GAME_RENDER:       game_render();              break;
+    case OP_SNAPSHOT_ROUND_TRIP:
+        game_snapshot_save(game_snapshot_buffer());
+        game_snapshot_restore(game_snapshot_buffer());
+        break;
+    case COUNT_OPS:
+    default:
+        UNREACHABLE();
+    }
+}
+
+static b32 first_result = TRUE;
+
+static void bench_op(u32 width, u32 height, u32 len, Op op)
+{
+    bench_setup(width, height, len);
+    Game saved = game;
+
+    f64 sum = 0.0;
+    f64 sum_sq = 0.0;
+    u32 calls = 0;
+    for (u32 i = 0; i < BENCH_SAMPLES; ++i) {
+        game = saved;
+        draw_calls = 0;
+        f64 start = now_ns();
+        op_run(op);
+        f64 ns = now_ns() - start - timer_overhead;
+        if (ns < 0.0) ns = 0.0;
+        sum += ns;
+        sum_sq += ns*ns;
+        calls = draw_calls;
+    }
+    game = saved;
+
+    f64 mean = sum/BENCH_SAMPLES;
+    f64 variance = sum_sq/BENCH_SAMPLES - mean*mean;
+    if (variance < 0.0) variance = 0.0;
+
+    printf("%s\n    {\"op\": \"%s\", \"width\": %u, \"height\": %u, \"snake_len\": %u, "
+           "\"ns_per_op\": %.1f, \"variance_ns2\": %.1f, \"stddev_ns\": %.1f, \"draw_calls\": %u}",
+           first_result ? "" : ",", op_names[op], width, height, len,
+           mean, variance, (f64)sqrtf(variance), calls);
+    first_result = FALSE;
+}
+
+int main(void)
+{
+    // NOTE: clock_gettime() itself is not free, subtract its cost from every sample
+    timer_overhead = 1e9;
+    for (u32 i = 0; i < 1000; ++i) {
+        f64 a = now_ns();
+        f64 b = now_ns();
+        if (b - a < timer_overhead) timer_overhead = b - a;
+    }
+
+    printf("{\n  \"samples\": %u,\n  \"timer_overhead_ns\": %.1f,\n  \"results\": [", BENCH_SAMPLES, timer_overhead);
+    for (size_t s = 0; s < sizeof(bench_sizes)/sizeof(bench_sizes[0]); ++s) {
+        for (size_t l = 0; l < sizeof(bench_snake_lens)/sizeof(bench_snake_lens[0]); ++l) {
+            for (Op op = 0; op < COUNT_OPS; ++op) {
+                bench_op(bench_sizes[s].width, bench_sizes[s].height, bench_snake_lens[l], op);
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+'use strict';
+
+// Compares game.wasm against game.simd.wasm on the same deterministic session:
+//   $ node bench_simd.js [game.wasm] [game.simd.wasm]
+// A long snake is restored from game_snapshot_serpentine() and stepped, then it turns into its own
+// body and the dead snake explosion is simulated for a while.
+
+const fs = require('fs');
+const { performance } = require('perf_hooks');
+
+const STEP_INTEVAL = 0.125; // must match game.c
+const SNAKE_LEN = 100; // the head is in the middle of a row, see the crash below
+const STEP_SAMPLES = 20000;
+const GAMEOVER_FRAMES = 20000;
+// See Snapshot in game.c
+const SNAPSHOT_HEADER_SIZE = 40;
+const SNAPSHOT_STATE_OFFSET = 28;
+const STATE_GAMEOVER = 2;
+
+function load(file_path) {
+    const noop = () => {};
+    const module = new WebAssembly.Module(fs.readFileSync(file_path));
+    const instance = new WebAssembly.Instance(module, {
+        env: {
+            platform_fill_rect: noop,
+            platform_stroke_rect: noop,
+            platform_fill_text: noop,
+            platform_text_width: (text_ptr, size) => size,
+            platform_log: noop,
+            platform_now_ns: () => 0n,
+            platform_panic: (file_path_ptr, line, message_ptr) => {
+                throw new Error(`${file_path}: game panicked at line ${line}`);
+            },
+        }
+    });
+    return instance.exports;
+}
+
+function bench(file_path) {
+    const game = load(file_path);
+    game.game_init(1600, 900);
+
+    const snapshot = game.game_snapshot_buffer();
+    const snapshot_size = game.game_snapshot_serpentine(snapshot, SNAKE_LEN);
+    const saved = new Uint8Array(game.memory.buffer, snapshot, snapshot_size).slice();
+    const restore = () => {
+        new Uint8Array(game.memory.buffer, snapshot, snapshot_size).set(saved);
+        game.game_snapshot_restore(snapshot);
+    };
+    restore();
+    if (game.game_snapshot_size() != SNAPSHOT_HEADER_SIZE + SNAKE_LEN*8) {
+        throw new Error(`${file_path}: expected a snake of ${SNAKE_LEN} cells`);
+    }
+
+    // The snapshot is in the middle of a step, so one game_update(STEP_INTEVAL) is exactly one step
+    const step_start = performance.now();
+    for (let i = 0; i < STEP_SAMPLES; ++i) {
+        restore();
+        game.game_update(STEP_INTEVAL);
+    }
+    const step_ms = performance.now() - step_start;
+
+    // Turning up in the middle of a row bites the row swept just before
+    restore();
+    game.game_keydown('w'.charCodeAt());
+    game.game_update(STEP_INTEVAL);
+    game.game_snapshot_save(snapshot);
+    if (new Uint8Array(game.memory.buffer)[snapshot + SNAPSHOT_STATE_OFFSET] != STATE_GAMEOVER) {
+        throw new Error(`${file_path}: the snake did not crash`);
+    }
+
+    const gameover_start = performance.now();
+    for (let frame = 0; frame < GAMEOVER_FRAMES; ++frame) {
+        game.game_update(1/60);
+    }
+    const gameover_ms = performance.now() - gameover_start;
+
+    return {
+        step_ns: step_ms*1e6/STEP_SAMPLES,
+        gameover_ns: gameover_ms*1e6/GAMEOVER_FRAMES,
+    };
+}
+
+const scalar_path = process.argv[2] || 'game.wasm';
+const simd_path = process.argv[3] || 'game.simd.wasm';
+
+// Warm up the JIT tiers before measuring
+bench(scalar_path);
+bench(simd_path);
+
+const scalar = bench(scalar_path);
+const simd = bench(simd_path);
+console.log(`                      ${scalar_path.padStart(16)} ${simd_path.padStart(16)}  speedup`);
+console.log(`restore + step        ${scalar.step_ns.toFixed(1).padStart(13)} ns ${simd.step_ns.toFixed(1).padStart(13)} ns  ${(scalar.step_ns/simd.step_ns).toFixed(2)}x`);
+console.log(`update (game over)    ${scalar.gameover_ns.toFixed(1).padStart(13)} ns ${simd.gameover_ns.toFixed(1).padStart(13)} ns  ${(scalar.gameover_ns/simd.gameover_ns).toFixed(2)}x`);
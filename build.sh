@@ -5,5 +5,27 @@ set -xe
 clang -Wall -Wextra -Wswitch-enum -c game.c
 clang -Wall -Wextra -Wswitch-enum -o sdl_main sdl_main.c game.o -lSDL2 -lSDL2_ttf -lm
 clang -Wall -Wextra -Wswitch-enum -I./include/ -o raylib_main raylib_main.c game.o -L./lib/ -lraylib -lm
+clang -Wall -Wextra -Wswitch-enum -o headless_main headless_main.c game.o
+clang -DRELEASE -Wall -Wextra -Wswitch-enum -c game.c -o game.release.o
+clang -Wall -Wextra -Wswitch-enum -o headless_main_release headless_main.c game.release.o
+# NOTE: optimized and without the dev features, like the build that actually ships
+clang -O2 -DRELEASE -Wall -Wextra -Wswitch-enum -o bench bench.c
 
-clang -Os -fno-builtin -Wall -Wextra -Wswitch-enum --target=wasm32 --no-standard-libraries -Wl,--export=game_init -Wl,--export=game_render -Wl,--export=game_update -Wl,--export=game_info -Wl,--export=game_keydown -Wl,--no-entry -Wl,--allow-undefined  -o game.wasm game.c
+./headless_main --golden golden.txt
+./headless_main_release --golden golden.release.txt
+
+WASM_FLAGS="-Os -fno-builtin -mbulk-memory -Wall -Wextra -Wswitch-enum --target=wasm32 --no-standard-libraries -Wl,--export=game_init -Wl,--export=game_render -Wl,--export=game_update -Wl,--export=game_info -Wl,--export=game_keydown -Wl,--export=game_input_ring -Wl,--export=game_input -Wl,--export=game_trace_ring -Wl,--export=game_latency_ring -Wl,--export=game_log_ring -Wl,--export=game_replay_buffer -Wl,--export=game_record_begin -Wl,--export=game_record_end -Wl,--export=game_replay_begin -Wl,--export=game_replay_seek -Wl,--export=game_replay_step -Wl,--export=game_replay_verify -Wl,--export=game_replay_tick -Wl,--export=game_replay_hash -Wl,--export=game_snapshot_buffer -Wl,--export=game_snapshot_size -Wl,--export=game_snapshot_save -Wl,--export=game_snapshot_restore -Wl,--export=game_snapshot_serpentine -Wl,--no-entry -Wl,--allow-undefined"
+clang $WASM_FLAGS -DRELEASE -o game.wasm game.c
+clang $WASM_FLAGS -DRELEASE -msimd128 -o game.simd.wasm game.c
+# NOTE: with the dev features and trace zones, not shipped, see `node wasm_headless.js --wasm game.dev.wasm --trace trace.json`
+clang $WASM_FLAGS -o game.dev.wasm game.c
+
+# NOTE: game.wasm is downloaded and compiled on every page load, keep an eye on its size
+WASM_SIZE_BUDGET=16384
+for wasm in game.wasm game.simd.wasm; do
+    size=$(wc -c < $wasm)
+    if [ $size -gt $WASM_SIZE_BUDGET ]; then
+        echo "ERROR: $wasm is $size bytes which is over the budget of $WASM_SIZE_BUDGET bytes"
+        exit 1
+    fi
+done
@@ -1,20 +1,47 @@
 #include "./game.h"
 
 // #define FEATURE_DYNAMIC_CAMERA
-#define FEATURE_DEV
 
+// NOTE: -DRELEASE strips the dev features, logging and stb_sprintf to keep game.wasm minimal
+#ifndef RELEASE
+#define FEATURE_DEV
+#define FEATURE_TRACE
 #define STB_SPRINTF_IMPLEMENTATION
 #include "stb_sprintf.h"
+#endif
+
+#define RUNTIME_IMPLEMENTATION
+#include "runtime.h"
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
 
 #define TRUE 1
 #define FALSE 0
 
-static char logf_buf[4096] = {0};
-#define LOGF(...) \
-    do { \
-        stbsp_snprintf(logf_buf, sizeof(logf_buf), __VA_ARGS__); \
-        platform_log(logf_buf); \
-    } while(0)
+// LOGF(fmt, ...) does not format anything, it copies the format, the time and up to LOG_MAX_ARGS
+// raw arguments into the log ring, see Log_Entry in game.h
+#ifdef RELEASE
+#define LOGF(...) do {} while(0)
+#else
+#define LOG_ARG(x) _Generic((x), \
+    float: log_arg_f64, \
+    double: log_arg_f64, \
+    char*: log_arg_ptr, \
+    const char*: log_arg_ptr, \
+    default: log_arg_int)(x)
+#define LOG_COUNT(...) LOG_COUNT_(__VA_ARGS__, 4, 3, 2, 1, 0, _)
+#define LOG_COUNT_(_0, _1, _2, _3, _4, N, ...) N
+#define LOG_CONCAT(a, b) LOG_CONCAT_(a, b)
+#define LOG_CONCAT_(a, b) a##b
+#define LOGF(...) LOG_CONCAT(LOGF_, LOG_COUNT(__VA_ARGS__))(__VA_ARGS__)
+#define LOGF_0(fmt)             log_push(fmt, 0, 0, 0, 0, 0)
+#define LOGF_1(fmt, a)          log_push(fmt, 1, LOG_ARG(a), 0, 0, 0)
+#define LOGF_2(fmt, a, b)       log_push(fmt, 2, LOG_ARG(a), LOG_ARG(b), 0, 0)
+#define LOGF_3(fmt, a, b, c)    log_push(fmt, 3, LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), 0)
+#define LOGF_4(fmt, a, b, c, d) log_push(fmt, 4, LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d))
+#endif
 
 static void platform_assert(const char *file, i32 line, b32 cond, const char *message)
 {
@@ -52,6 +79,38 @@ static void platform_assert(const char *file, i32 line, b32 cond, const char *me
 #define RAND_A 6364136223846793005ULL
 #define RAND_C 1442695040888963407ULL
 
+#ifdef FEATURE_DEV
+// Frame-time HUD toggled with DEV_HUD_KEY. A sample is recorded every frame even while it's hidden,
+// which is one ring push, the statistics are only computed when it's shown.
+#define DEV_HUD_KEY 'h'
+#define DEV_HUD_SAMPLES 120
+typedef struct {
+    f32 dt;
+    u32 steps;
+    u32 draw_calls;
+} Dev_Frame;
+
+typedef struct {
+    u32 begin;
+    u32 size;
+    Dev_Frame items[DEV_HUD_SAMPLES];
+} Dev_Frames;
+
+// NOTE: game_restart() wipes Game, the state that has to survive it lives in statics like this one
+static struct {
+    b32 visible;
+    Dev_Frames frames;
+    u32 steps;
+    u32 draw_calls;
+} dev_hud = {0};
+
+#define DEV_COUNT_STEP() (dev_hud.steps += 1)
+#define DEV_COUNT_DRAW() (dev_hud.draw_calls += 1)
+#else
+#define DEV_COUNT_STEP() do {} while(0)
+#define DEV_COUNT_DRAW() do {} while(0)
+#endif
+
 typedef enum {
     ALIGN_LEFT,
     ALIGN_RIGHT,
@@ -60,6 +119,7 @@ typedef enum {
 
 static void fill_text_aligned(i32 x, i32 y, const char *text, u32 size, u32 color, Align align)
 {
+    DEV_COUNT_DRAW();
     u32 width = platform_text_width(text, size);
     switch (align) {
     case ALIGN_LEFT:                 break;
@@ -69,21 +129,15 @@ static void fill_text_aligned(i32 x, i32 y, const char *text, u32 size, u32 colo
     platform_fill_text(x, y, text, size, color);
 }
 
+// NOTE: outside of rand() so the recordings can capture and restore it
+static u64 rand_state = 0;
+
 static u32 rand(void)
 {
-    static u64 rand_state = 0;
     rand_state = rand_state*RAND_A + RAND_C;
     return (rand_state >> 32)&0xFFFFFFFF;
 }
 
-static void *memset(void *mem, u32 c, u32 n)
-{
-    void *result = mem;
-    u8 *bytes = mem;
-    while (n-- > 0) *bytes++ = c;
-    return result;
-}
-
 typedef enum {
     DIR_RIGHT = 0,
     DIR_UP,
@@ -158,11 +212,16 @@ typedef enum {
     STATE_GAMEOVER,
 } State;
 
+typedef struct {
+    Dir dir;
+    f64 time; // of the input event, negative if unknown
+} Dir_Input;
+
 #define DIR_QUEUE_CAP 3
 typedef struct {
     u32 begin;
     u32 size;
-    Dir items[DIR_QUEUE_CAP];
+    Dir_Input items[DIR_QUEUE_CAP];
 } Dir_Queue;
 
 typedef struct {
@@ -191,7 +250,7 @@ typedef struct {
     b32 infinite_field;
 
     u32 score;
-    char score_buffer[256];
+    char score_buffer[32];
 } Game;
 
 static Game game = {0};
@@ -247,19 +306,193 @@ static Rect cell_rect(Cell cell)
     (ASSERT((ring)->size > 0, "Ring buffer is empty"), \
      &(ring)->items[((ring)->begin + (index))%ring_cap(ring)])
 
+#ifdef FEATURE_TRACE
+static Trace_Ring trace_ring = {0};
+
+#define TRACE_STACK_CAP 16
+static struct {
+    const char *names[TRACE_STACK_CAP];
+    u64 begins[TRACE_STACK_CAP];
+    u32 size;
+} trace_stack = {0};
+
+static void trace_begin(const char *name)
+{
+    ASSERT(trace_stack.size < TRACE_STACK_CAP, "Trace zones are nested too deep");
+    trace_stack.names[trace_stack.size] = name;
+    trace_stack.begins[trace_stack.size] = platform_now_ns();
+    trace_stack.size += 1;
+}
+
+static void trace_end(void)
+{
+    u64 now = platform_now_ns();
+    ASSERT(trace_stack.size > 0, "Trace zone ended without beginning");
+    trace_stack.size -= 1;
+    Trace_Zone zone = {
+        .begin_ns = trace_stack.begins[trace_stack.size],
+        .end_ns   = now,
+        .name     = trace_stack.names[trace_stack.size],
+        .depth    = trace_stack.size,
+    };
+    ring_displace_back(&trace_ring, zone);
+}
+
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END() trace_end()
+#else
+#define TRACE_BEGIN(name) do {} while(0)
+#define TRACE_END() do {} while(0)
+#endif
+
+Trace_Ring *game_trace_ring(void)
+{
+#ifdef FEATURE_TRACE
+    return &trace_ring;
+#else
+    return NULL;
+#endif
+}
+
+#ifndef RELEASE
+static Log_Ring log_ring = {0};
+
+static u64 log_arg_int(long long x)
+{
+    return x;
+}
+
+static u64 log_arg_f64(f64 x)
+{
+    union { f64 f; u64 u; } bits = {.f = x};
+    return bits.u;
+}
+
+static u64 log_arg_ptr(const char *x)
+{
+    return (size_t)x;
+}
+
+static void log_push(const char *fmt, u32 nargs, u64 a, u64 b, u64 c, u64 d)
+{
+    Log_Entry entry = {
+        .time_ns = platform_now_ns(),
+        .fmt     = fmt,
+        .nargs   = nargs,
+        .args    = {a, b, c, d},
+    };
+    ring_displace_back(&log_ring, entry);
+}
+#endif
+
+Log_Ring *game_log_ring(void)
+{
+#ifndef RELEASE
+    return &log_ring;
+#else
+    return NULL;
+#endif
+}
+
+void game_log_flush(void)
+{
+#ifndef RELEASE
+    static char message[1024];
+    while (!ring_empty(&log_ring)) {
+        Log_Entry *entry = ring_front(&log_ring);
+        u32 n = 0;
+        u32 arg = 0;
+        for (const char *p = entry->fmt; *p != '\0' && n < sizeof(message) - 1;) {
+            if (*p != '%' || p[1] == '%') {
+                message[n++] = *p;
+                p += *p == '%' ? 2 : 1;
+                continue;
+            }
+
+            // One conversion at a time, cast to what its specifier expects
+            char spec[16];
+            u32 len = 0;
+            b32 long_long = FALSE;
+            do {
+                if (*p == 'l' && p[1] == 'l') long_long = TRUE;
+                spec[len++] = *p++;
+            } while (*p != '\0' && len < sizeof(spec) - 2 && !(('a' <= *p && *p <= 'z' && *p != 'l' && *p != 'h') || ('A' <= *p && *p <= 'Z')));
+            char conversion = *p;
+            if (conversion != '\0') spec[len++] = *p++;
+            spec[len] = '\0';
+
+            u64 x = arg < entry->nargs ? entry->args[arg] : 0;
+            arg += 1;
+            char *out = &message[n];
+            u32 size = sizeof(message) - n;
+            switch (conversion) {
+            case 'd': case 'i': case 'c':
+                n += long_long ? stbsp_snprintf(out, size, spec, (long long)x) : stbsp_snprintf(out, size, spec, (int)x);
+                break;
+            case 'u': case 'x': case 'X': case 'o': case 'b':
+                n += long_long ? stbsp_snprintf(out, size, spec, (unsigned long long)x) : stbsp_snprintf(out, size, spec, (unsigned)x);
+                break;
+            case 'f': case 'e': case 'E': case 'g': case 'G': {
+                union { u64 u; f64 f; } bits = {.u = x};
+                n += stbsp_snprintf(out, size, spec, bits.f);
+            } break;
+            case 's':
+                n += stbsp_snprintf(out, size, spec, (const char*)(size_t)x);
+                break;
+            case 'p':
+                n += stbsp_snprintf(out, size, spec, (void*)(size_t)x);
+                break;
+            default:
+                n += stbsp_snprintf(out, size, "%s", spec);
+            }
+            if (n > sizeof(message) - 1) n = sizeof(message) - 1;
+        }
+        message[n] = '\0';
+        platform_log(message);
+        ring_pop_front(&log_ring);
+    }
+#endif
+}
+
 static b32 cell_eq(Cell a, Cell b)
 {
     return a.x == b.x && a.y == b.y;
 }
 
+static i32 cells_find(const Cell *cells, u32 count, Cell cell)
+{
+    u32 i = 0;
+#ifdef __wasm_simd128__
+    // NOTE: a Cell is exactly 64 bits, so two of them fit into a single v128 and compare as i64 lanes
+    v128_t needle = wasm_i32x4_make(cell.x, cell.y, cell.x, cell.y);
+    for (; i + 4 <= count; i += 4) {
+        v128_t a = wasm_i64x2_eq(wasm_v128_load(&cells[i]),     needle);
+        v128_t b = wasm_i64x2_eq(wasm_v128_load(&cells[i + 2]), needle);
+        u32 mask = wasm_i64x2_bitmask(a) | (wasm_i64x2_bitmask(b) << 2);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < count; ++i) {
+        if (cell_eq(cells[i], cell)) return i;
+    }
+    return -1;
+}
+
 static i32 is_cell_snake_body(Cell cell)
 {
     // TODO: ignoring the tail feel hacky @tail-ignore
-    for (u32 index = 1; index < game.snake.size; ++index) {
-        if (cell_eq(*ring_get(&game.snake, index), cell)) {
-            return index;
-        }
-    }
+    if (game.snake.size <= 1) return -1;
+
+    // The body is at most two contiguous spans of the ring
+    u32 first = (game.snake.begin + 1)%ring_cap(&game.snake);
+    u32 count = game.snake.size - 1;
+    u32 span  = ring_cap(&game.snake) - first;
+    if (span > count) span = count;
+
+    i32 index = cells_find(&game.snake.items[first], span, cell);
+    if (index >= 0) return index + 1;
+    index = cells_find(&game.snake.items[0], count - span, cell);
+    if (index >= 0) return span + index + 1;
     return -1;
 }
 
@@ -329,10 +562,32 @@ static void random_egg(b32 first)
     ASSERT(attempt <= RANDOM_EGG_MAX_ATTEMPTS, "TODO: make sure we have always at least one free visible cell");
 }
 
+static u32 u32_format(char *buffer, u32 value)
+{
+    char digits[10];
+    u32 count = 0;
+    do {
+        digits[count++] = '0' + value%10;
+        value /= 10;
+    } while (value > 0);
+    for (u32 i = 0; i < count; ++i) buffer[i] = digits[count - 1 - i];
+    return count;
+}
+
+// NOTE: must be called every time game.score changes, game_render() only uses the cached text
+static void score_format(void)
+{
+    static const char prefix[] = "Score: ";
+    u32 n = 0;
+    for (; prefix[n] != '\0'; ++n) game.score_buffer[n] = prefix[n];
+    n += u32_format(&game.score_buffer[n], game.score);
+    game.score_buffer[n] = '\0';
+}
+
 // TODO: animation on restart
 static void game_restart(u32 width, u32 height)
 {
-    memset(&game, 0, sizeof(game));
+    rt_memset(&game, 0, sizeof(game));
 
 #ifdef FEATURE_DEV
     game.dt_scale = 1.0f;
@@ -349,9 +604,7 @@ static void game_restart(u32 width, u32 height)
     }
     random_egg(TRUE);
     game.dir = DIR_RIGHT;
-    // TODO: Using snprintf to render Score is an overkill
-    // I believe snprintf should be only used for LOGF and in the "release" build stbsp_snprintf should not be included at all
-    stbsp_snprintf(game.score_buffer, sizeof(game.score_buffer), "Score: %u", game.score);
+    score_format();
 }
 
 static f32 lerpf(f32 a, f32 b, f32 t)
@@ -366,6 +619,7 @@ static f32 ilerpf(f32 a, f32 b, f32 v)
 
 static void fill_rect(Rect rect, u32 color)
 {
+    DEV_COUNT_DRAW();
     platform_fill_rect(
         rect.x - game.camera_pos.x + game.width/2,
         rect.y - game.camera_pos.y + game.height/2,
@@ -375,6 +629,7 @@ static void fill_rect(Rect rect, u32 color)
 #ifdef FEATURE_DEV
 static void stroke_rect(Rect rect, u32 color)
 {
+    DEV_COUNT_DRAW();
     platform_stroke_rect(
         rect.x - game.camera_pos.x + game.width/2,
         rect.y - game.camera_pos.y + game.height/2,
@@ -588,33 +843,146 @@ static void dead_snake_render(void)
     }
 }
 
+// Latency tracking
+static f64 keydown_time = -1.0;   // time of the input event game_keydown() is processing
+static f64 update_end_time = 0.0; // end of the current game_update() on the input clock
+static Latency_Ring latency_consumed_ring = {0};
+static Latency_Ring latency_ring = {0};
+
+static void dir_input(Dir dir)
+{
+    Dir_Input input = {.dir = dir, .time = keydown_time};
+    ring_displace_back(&game.next_dirs, input);
+}
+
+static void latency_consumed(f64 input_time)
+{
+    if (input_time < 0.0) return;
+    Latency_Sample sample = {.input_time = input_time, .consume_time = update_end_time};
+    ring_displace_back(&latency_consumed_ring, sample);
+}
+
+Latency_Ring *game_latency_ring(void)
+{
+    return &latency_ring;
+}
+
+#ifdef FEATURE_DEV
+#define DEV_HUD_BAR_WIDTH 3
+#define DEV_HUD_GRAPH_HEIGHT 100
+#define DEV_HUD_GRAPH_MAX_DT (1.0f/20.0f)
+#define DEV_HUD_TARGET_DT (1.0f/60.0f)
+#define DEV_HUD_FONT_SIZE 24
+#define DEV_HUD_PANEL_COLOR 0xAA000000
+#define DEV_HUD_GOOD_COLOR 0xFF18C018
+#define DEV_HUD_SLOW_COLOR 0xFF18C0C0
+#define DEV_HUD_HITCH_COLOR 0xFF1818C0
+#define DEV_HUD_TARGET_COLOR 0xFFFFFFFF
+#define DEV_HUD_FONT_COLOR 0xFFFFFFFF
+
+static void dev_hud_render(void)
+{
+    u32 n = dev_hud.frames.size;
+    if (n == 0) return;
+
+    i32 x0 = SCORE_PADDING;
+    i32 y1 = game.height - SCORE_PADDING;
+    i32 y0 = y1 - DEV_HUD_GRAPH_HEIGHT;
+    i32 w  = DEV_HUD_SAMPLES*DEV_HUD_BAR_WIDTH;
+
+    platform_fill_rect(x0, y0 - 3*DEV_HUD_FONT_SIZE, w, DEV_HUD_GRAPH_HEIGHT + 3*DEV_HUD_FONT_SIZE, DEV_HUD_PANEL_COLOR);
+
+    // The graph, oldest frame on the left
+    f32 dts[DEV_HUD_SAMPLES];
+    u32 steps = 0;
+    for (u32 i = 0; i < n; ++i) {
+        Dev_Frame *frame = ring_get(&dev_hud.frames, i);
+        f32 dt = frame->dt;
+        dts[i] = dt;
+        steps += frame->steps;
+
+        if (dt > DEV_HUD_GRAPH_MAX_DT) dt = DEV_HUD_GRAPH_MAX_DT;
+        i32 h = dt/DEV_HUD_GRAPH_MAX_DT*DEV_HUD_GRAPH_HEIGHT;
+        if (h < 1) h = 1;
+        u32 color = frame->dt <= DEV_HUD_TARGET_DT*1.05f ? DEV_HUD_GOOD_COLOR
+                  : frame->dt <= DEV_HUD_TARGET_DT*2.05f ? DEV_HUD_SLOW_COLOR
+                  : DEV_HUD_HITCH_COLOR;
+        platform_fill_rect(x0 + i*DEV_HUD_BAR_WIDTH, y1 - h, DEV_HUD_BAR_WIDTH - 1, h, color);
+    }
+    i32 target_y = y1 - DEV_HUD_TARGET_DT/DEV_HUD_GRAPH_MAX_DT*DEV_HUD_GRAPH_HEIGHT;
+    platform_fill_rect(x0, target_y, w, 1, DEV_HUD_TARGET_COLOR);
+
+    // Insertion sort is plenty for DEV_HUD_SAMPLES
+    for (u32 i = 1; i < n; ++i) {
+        f32 x = dts[i];
+        u32 j = i;
+        for (; j > 0 && dts[j - 1] > x; --j) dts[j] = dts[j - 1];
+        dts[j] = x;
+    }
+
+    static char buffer[128];
+    stbsp_snprintf(buffer, sizeof(buffer), "p50 %.1fms  p99 %.1fms  max %.1fms",
+                   dts[n*50/100]*1000.0f, dts[n*99/100]*1000.0f, dts[n - 1]*1000.0f);
+    platform_fill_text(x0, y0 - 2*DEV_HUD_FONT_SIZE, buffer, DEV_HUD_FONT_SIZE, DEV_HUD_FONT_COLOR);
+
+    stbsp_snprintf(buffer, sizeof(buffer), "draws %u  steps %u/%u frames",
+                   ring_back(&dev_hud.frames)->draw_calls, steps, n);
+    platform_fill_text(x0, y0 - DEV_HUD_FONT_SIZE/2, buffer, DEV_HUD_FONT_SIZE, DEV_HUD_FONT_COLOR);
+}
+#endif
+
 void game_render(void)
 {
+    TRACE_BEGIN("game_render");
+
+    // This frame is the first one to show the turns consumed since the previous one
+    while (!ring_empty(&latency_consumed_ring)) {
+        ring_displace_back(&latency_ring, *ring_front(&latency_consumed_ring));
+        ring_pop_front(&latency_consumed_ring);
+    }
+
+    TRACE_BEGIN("background");
+    background_render();
+    TRACE_END();
+
+    TRACE_BEGIN("egg");
+    egg_render();
+    TRACE_END();
+
     switch (game.state) {
     case STATE_GAMEPLAY: {
-        background_render();
-        egg_render();
+        TRACE_BEGIN("snake");
         snake_render();
+        TRACE_END();
+
+        TRACE_BEGIN("text");
         fill_text_aligned(SCORE_PADDING, SCORE_PADDING, game.score_buffer, SCORE_FONT_SIZE, SCORE_FONT_COLOR, ALIGN_LEFT);
+        TRACE_END();
     }
     break;
 
     case STATE_PAUSE: {
-        background_render();
-        egg_render();
+        TRACE_BEGIN("snake");
         snake_render();
+        TRACE_END();
+
+        TRACE_BEGIN("text");
         fill_text_aligned(SCORE_PADDING, SCORE_PADDING, game.score_buffer, SCORE_FONT_SIZE, SCORE_FONT_COLOR, ALIGN_LEFT);
         // TODO: "Pause", "Game Over" are not centered vertically
         fill_text_aligned(game.width/2, game.height/2, "Pause", PAUSE_FONT_SIZE, PAUSE_FONT_COLOR, ALIGN_CENTER);
+        TRACE_END();
     }
     break;
 
     case STATE_GAMEOVER: {
-        background_render();
-        egg_render();
+        TRACE_BEGIN("dead_snake");
         dead_snake_render();
+        TRACE_END();
+
+        TRACE_BEGIN("text");
         fill_text_aligned(SCORE_PADDING, SCORE_PADDING, game.score_buffer, SCORE_FONT_SIZE, SCORE_FONT_COLOR, ALIGN_LEFT);
         fill_text_aligned(game.width/2, game.height/2, "Game Over", GAMEOVER_FONT_SIZE, GAMEOVER_FONT_COLOR, ALIGN_CENTER);
+        TRACE_END();
     }
     break;
 
@@ -627,11 +995,233 @@ void game_render(void)
     fill_text_aligned(game.width - SCORE_PADDING, SCORE_PADDING, "Dev", SCORE_FONT_SIZE, SCORE_FONT_COLOR, ALIGN_RIGHT);
     Rect rect = { .w = COLS*CELL_SIZE, .h = ROWS*CELL_SIZE };
     stroke_rect(rect, 0xFF0000FF);
+
+    // NOTE: the HUD itself is not counted
+    if (!ring_empty(&dev_hud.frames)) ring_back(&dev_hud.frames)->draw_calls = dev_hud.draw_calls;
+    dev_hud.draw_calls = 0;
+    if (dev_hud.visible) dev_hud_render();
 #endif
+
+    TRACE_END();
+}
+
+static u32 sim_tick = 0; // snake steps since the recording or the replay started
+
+// The part of a snapshot before the cells of the snake, which follow it from the tail to the head
+typedef struct {
+    u64 rand_state;
+    u32 tick;
+    u32 score;
+    Cell egg;
+    f32 step_cooldown;
+    u8 state;
+    u8 dir;
+    u8 eating_egg;
+    u8 infinite_field;
+    u8 next_dirs[DIR_QUEUE_CAP];
+    u8 next_dirs_size;
+    u32 snake_size;
+} Snapshot;
+
+// NOTE: recordings keep snapshots byte for byte, the layout must be the same on every target
+_Static_assert(sizeof(Snapshot) == 40, "the layout of Snapshot changed, bump REPLAY_VERSION");
+_Static_assert(sizeof(Snapshot) + SNAKE_CAP*sizeof(Cell) <= GAME_SNAPSHOT_CAP, "GAME_SNAPSHOT_CAP is too small for the board");
+
+static u8 snapshot_buffer[GAME_SNAPSHOT_CAP];
+
+u8 *game_snapshot_buffer(void)
+{
+    return snapshot_buffer;
+}
+
+u32 game_snapshot_size(void)
+{
+    return sizeof(Snapshot) + game.snake.size*sizeof(Cell);
+}
+
+u32 game_snapshot_save(void *buffer)
+{
+    Snapshot snapshot = {
+        .rand_state     = rand_state,
+        .tick           = sim_tick,
+        .score          = game.score,
+        .egg            = game.egg,
+        .step_cooldown  = game.step_cooldown,
+        .state          = game.state,
+        .dir            = game.dir,
+        .eating_egg     = game.eating_egg,
+        .infinite_field = game.infinite_field,
+        .next_dirs_size = game.next_dirs.size,
+        .snake_size     = game.snake.size,
+    };
+    for (u32 i = 0; i < game.next_dirs.size; ++i) {
+        snapshot.next_dirs[i] = ring_get(&game.next_dirs, i)->dir;
+    }
+    u8 *bytes = buffer;
+    rt_memcpy(bytes, &snapshot, sizeof(snapshot));
+
+    // The snake is at most two contiguous spans of the ring
+    u32 span = ring_cap(&game.snake) - game.snake.begin;
+    if (span > game.snake.size) span = game.snake.size;
+    rt_memcpy(bytes + sizeof(snapshot), &game.snake.items[game.snake.begin], span*sizeof(Cell));
+    rt_memcpy(bytes + sizeof(snapshot) + span*sizeof(Cell), &game.snake.items[0], (game.snake.size - span)*sizeof(Cell));
+    return sizeof(snapshot) + game.snake.size*sizeof(Cell);
+}
+
+void game_snapshot_restore(const void *buffer)
+{
+    Snapshot snapshot;
+    const u8 *bytes = buffer;
+    rt_memcpy(&snapshot, bytes, sizeof(snapshot));
+
+    rand_state          = snapshot.rand_state;
+    sim_tick            = snapshot.tick;
+    game.score          = snapshot.score;
+    game.egg            = snapshot.egg;
+    game.step_cooldown  = snapshot.step_cooldown;
+    game.state          = snapshot.state;
+    game.dir            = snapshot.dir;
+    game.eating_egg     = snapshot.eating_egg;
+    game.infinite_field = snapshot.infinite_field;
+
+    game.next_dirs.begin = 0;
+    game.next_dirs.size  = snapshot.next_dirs_size;
+    for (u32 i = 0; i < snapshot.next_dirs_size; ++i) {
+        game.next_dirs.items[i].dir  = snapshot.next_dirs[i];
+        game.next_dirs.items[i].time = -1.0;
+    }
+
+    game.snake.begin = 0;
+    game.snake.size  = snapshot.snake_size;
+    rt_memcpy(game.snake.items, bytes + sizeof(snapshot), snapshot.snake_size*sizeof(Cell));
+
+    // The derived state: the cached score text, the camera looking where it would be looking,
+    // and no fragments flying around
+    score_format();
+    if (game.infinite_field) {
+        game.camera_pos = cell_center(*ring_back(&game.snake));
+    } else {
+        game.camera_pos.x = game.width/2;
+        game.camera_pos.y = game.height/2;
+    }
+    game.camera_vel.x = 0;
+    game.camera_vel.y = 0;
+    game.dead_snake.size = 0;
+}
+
+// The board walked row by row, every next cell is adjacent to the previous one
+static Cell serpentine_cell(u32 index)
+{
+    i32 row = index/COLS;
+    i32 col = index%COLS;
+    if (row%2 != 0) col = COLS - 1 - col;
+    return (Cell) {.x = col, .y = row};
+}
+
+u32 game_snapshot_serpentine(void *buffer, u32 len)
+{
+    if (len < 1) len = 1;
+    if (len > SNAKE_CAP - 1) len = SNAKE_CAP - 1;
+    Snapshot snapshot = {
+        .rand_state    = rand_state,
+        .score         = len > SNAKE_INIT_SIZE ? len - SNAKE_INIT_SIZE : 0,
+        .egg           = serpentine_cell(SNAKE_CAP - 1),
+        // NOTE: the middle of a step, so game_advance(STEP_INTEVAL) performs exactly one step
+        .step_cooldown = STEP_INTEVAL*0.5f,
+        .state         = STATE_GAMEPLAY,
+        .dir           = cells_dir(serpentine_cell(len - 1), serpentine_cell(len)),
+        .snake_size    = len,
+    };
+    u8 *bytes = buffer;
+    rt_memcpy(bytes, &snapshot, sizeof(snapshot));
+    for (u32 i = 0; i < len; ++i) {
+        Cell cell = serpentine_cell(i);
+        rt_memcpy(bytes + sizeof(snapshot) + i*sizeof(Cell), &cell, sizeof(cell));
+    }
+    return sizeof(snapshot) + len*sizeof(Cell);
+}
+
+// See game_record_begin() in game.h for the format
+#define REPLAY_MAGIC 0x524B4E53 // "SNKR"
+#define REPLAY_VERSION 3
+#define REPLAY_HEADER_SIZE 24
+#define REPLAY_FOOTER_SIZE 24
+#define REPLAY_KEYFRAME 0 // in place of the key of an event
+#define REPLAY_KEYFRAME_INTERVAL 256
+// NOTE: a recording has no time between the death and the restart at the same tick, a replay
+// still plays this many frames of the explosion so game_replay_hash() covers dead_snake_update()
+#define REPLAY_GAMEOVER_FRAMES 64
+#define REPLAY_GAMEOVER_DT (1.0f/64.0f)
+
+static u8 replay_buffer[REPLAY_CAP];
+static struct {
+    b32 recording;
+    b32 replaying;
+    u32 size;       // of the recording in replay_buffer, may go past REPLAY_CAP when recording
+    u32 cursor;     // of the next event when replaying
+    u32 events_end; // where the index starts
+    u32 keyframe_interval;
+    u32 index_count;
+    u32 count;      // of the events written or read so far
+    u32 event_tick; // of the last event written or read
+    b32 has_event;  // the event read ahead when replaying
+    i32 event_key;
+    u32 final_tick;
+    u64 final_hash;
+    u32 gameover_frames; // played since the last death when replaying
+} replay = {0};
+
+static void replay_write_u8(u8 x)
+{
+    if (replay.size < REPLAY_CAP) replay_buffer[replay.size] = x;
+    replay.size += 1;
+}
+
+static void replay_write_u32(u32 x)
+{
+    for (u32 i = 0; i < 4; ++i) replay_write_u8((x >> i*8)&0xFF);
+}
+
+static void replay_write_u64(u64 x)
+{
+    replay_write_u32(x&0xFFFFFFFF);
+    replay_write_u32(x >> 32);
+}
+
+static void replay_write_varint(u32 x)
+{
+    while (x >= 0x80) {
+        replay_write_u8((x&0x7F)|0x80);
+        x >>= 7;
+    }
+    replay_write_u8(x);
+}
+
+static void replay_record_key(int key)
+{
+    replay_write_varint(sim_tick - replay.event_tick);
+    replay_write_varint(key + 1);
+    replay.event_tick = sim_tick;
+    replay.count += 1;
+}
+
+// The event count so far and a snapshot of the state right after the step of the current tick
+static void replay_record_keyframe(void)
+{
+    u32 size = game_snapshot_size();
+    replay_write_varint(sim_tick - replay.event_tick);
+    replay_write_varint(REPLAY_KEYFRAME);
+    replay_write_varint(4 + size);
+    replay_write_u32(replay.count);
+    if (replay.size + size <= REPLAY_CAP) game_snapshot_save(&replay_buffer[replay.size]);
+    replay.size += size;
+    replay.event_tick = sim_tick;
 }
 
 void game_keydown(int key)
 {
+    if (replay.recording) replay_record_key(key);
+
 #ifdef FEATURE_DEV
 #define DEV_DT_SCALE_STEP 0.05f
     switch (key) {
@@ -648,6 +1238,9 @@ void game_keydown(int key)
         game.dt_scale = 1.0f;
         LOGF("dt scale = %f", game.dt_scale);
         break;
+    case DEV_HUD_KEY:
+        dev_hud.visible = !dev_hud.visible;
+        break;
     }
 #endif
 
@@ -655,16 +1248,16 @@ void game_keydown(int key)
     case STATE_GAMEPLAY: {
         switch (key) {
         case KEY_UP:
-            ring_displace_back(&game.next_dirs, DIR_UP);
+            dir_input(DIR_UP);
             break;
         case KEY_DOWN:
-            ring_displace_back(&game.next_dirs, DIR_DOWN);
+            dir_input(DIR_DOWN);
             break;
         case KEY_LEFT:
-            ring_displace_back(&game.next_dirs, DIR_LEFT);
+            dir_input(DIR_LEFT);
             break;
         case KEY_RIGHT:
-            ring_displace_back(&game.next_dirs, DIR_RIGHT);
+            dir_input(DIR_RIGHT);
             break;
         case KEY_ACCEPT:
             game.state = STATE_PAUSE;
@@ -727,13 +1320,138 @@ static f32 vec_len(Vec a)
     return sqrtf(a.x*a.x + a.y*a.y);
 }
 
+#define DEAD_SNAKE_DAMPING 0.99f
+
+static void dead_snake_update(f32 dt)
+{
+    // @tail-ignore
+    u32 i = 1;
+#ifdef __wasm_simd128__
+    // NOTE: produces bit-identical results with the scalar loop below. Two fragments per iteration:
+    // both velocities fit into one v128 and each Rect is a v128 where w and h get +0.0f.
+    v128_t damping = wasm_f32x4_splat(DEAD_SNAKE_DAMPING);
+    v128_t dt4     = wasm_f32x4_splat(dt);
+    v128_t zero    = wasm_f32x4_splat(0.0f);
+    for (; i + 2 <= game.dead_snake.size; i += 2) {
+        v128_t vels = wasm_f32x4_mul(wasm_v128_load(&game.dead_snake.vels[i]), damping);
+        wasm_v128_store(&game.dead_snake.vels[i], vels);
+        v128_t delta = wasm_f32x4_mul(vels, dt4);
+        v128_t a = wasm_v128_load(&game.dead_snake.items[i]);
+        v128_t b = wasm_v128_load(&game.dead_snake.items[i + 1]);
+        wasm_v128_store(&game.dead_snake.items[i],     wasm_f32x4_add(a, wasm_i32x4_shuffle(delta, zero, 0, 1, 4, 5)));
+        wasm_v128_store(&game.dead_snake.items[i + 1], wasm_f32x4_add(b, wasm_i32x4_shuffle(delta, zero, 2, 3, 4, 5)));
+    }
+#endif
+    for (; i < game.dead_snake.size; ++i) {
+        game.dead_snake.vels[i].x *= DEAD_SNAKE_DAMPING;
+        game.dead_snake.vels[i].y *= DEAD_SNAKE_DAMPING;
+        game.dead_snake.items[i].x += game.dead_snake.vels[i].x*dt;
+        game.dead_snake.items[i].y += game.dead_snake.vels[i].y*dt;
+    }
+}
+
 void game_resize(u32 width, u32 height)
 {
     game.width = width;
     game.height = height;
 }
 
-void game_update(f32 dt)
+// One step of the snake, FALSE if it bit itself and the game is over
+static b32 game_step(void)
+{
+    sim_tick += 1;
+
+    if (!ring_empty(&game.next_dirs)) {
+        Dir_Input next = *ring_front(&game.next_dirs);
+        if (dir_opposite(game.dir) != next.dir) {
+            if (game.dir != next.dir) latency_consumed(next.time);
+            game.dir = next.dir;
+        }
+        ring_pop_front(&game.next_dirs);
+    }
+
+    Cell next_head = step_cell(*ring_back(&game.snake), game.dir);
+
+    if (cell_eq(game.egg, next_head)) {
+        ring_push_back(&game.snake, next_head);
+        TRACE_BEGIN("egg_placement");
+        random_egg(FALSE);
+        TRACE_END();
+        game.eating_egg = TRUE;
+#ifdef FEATURE_DYNAMIC_CAMERA
+        game.infinite_field = TRUE;
+#endif
+        game.score += 1;
+        score_format();
+    } else {
+        TRACE_BEGIN("collision");
+        i32 next_head_index = is_cell_snake_body(next_head);
+        TRACE_END();
+        if (next_head_index >= 0) {
+            TRACE_BEGIN("death");
+            // NOTE: reseting step_cooldown to 0 is important bcause the whole smooth movement is based on it.
+            // Without this reset the head of the snake "detaches" from the snake on the Game Over, when
+            // step_cooldown < 0.0f
+            game.step_cooldown = 0.0f;
+            game.state = STATE_GAMEOVER;
+
+            game.dead_snake.size = game.snake.size;
+            Vec head_center = cell_center(next_head);
+            for (u32 i = 0; i < game.snake.size; ++i) {
+#define GAMEOVER_EXPLOSION_RADIUS 1000.0f
+#define GAMEOVER_EXPLOSION_MAX_VEL 200.0f
+                Cell cell = *ring_get(&game.snake, i);
+                game.dead_snake.items[i] = cell_rect(cell);
+                if (!cell_eq(cell, next_head)) {
+                    Vec vel_vec = vec_sub(cell_center(cell), head_center);
+                    f32 vel_len = vec_len(vel_vec);
+                    f32 t = ilerpf(0.0f, GAMEOVER_EXPLOSION_RADIUS, vel_len);
+                    if (t > 1.0f) t = 1.0f;
+                    t = 1.0f - t;
+                    f32 noise_x = (rand()%1000)*0.01;
+                    f32 noise_y = (rand()%1000)*0.01;
+                    vel_vec.x = vel_vec.x/vel_len*GAMEOVER_EXPLOSION_MAX_VEL*t + noise_x;
+                    vel_vec.y = vel_vec.y/vel_len*GAMEOVER_EXPLOSION_MAX_VEL*t + noise_y;
+                    game.dead_snake.vels[i] = vel_vec;
+                    // TODO: additional velocities along the body of the dead snake
+                } else {
+                    game.dead_snake.vels[i].x = 0;
+                    game.dead_snake.vels[i].y = 0;
+                }
+
+                // @tail-ignore
+                if (i > 0) {
+                    game.dead_snake.masks[i] = 0;
+                    if (i > 1) {
+                        game.dead_snake.masks[i] |= 1 << cells_dir(cell, *ring_get(&game.snake, i - 1));
+                    }
+                    if (i < game.snake.size - 1) {
+                        game.dead_snake.masks[i] |= 1 << cells_dir(cell, *ring_get(&game.snake, i + 1));
+                    }
+                }
+                if (i == game.snake.size - 1) {
+                    game.dead_snake.masks[i] |= 1 << game.dir;
+                }
+            }
+
+            game.dead_snake.masks[next_head_index] |= 1 << cells_dir(
+                        *ring_get(&game.snake, next_head_index),
+                        *ring_get(&game.snake, game.snake.size - 1));
+
+            TRACE_END();
+            return FALSE;
+        } else {
+            ring_push_back(&game.snake, next_head);
+            ring_pop_front(&game.snake);
+            game.eating_egg = FALSE;
+        }
+    }
+
+    if (replay.recording && sim_tick%REPLAY_KEYFRAME_INTERVAL == 0) replay_record_keyframe();
+    return TRUE;
+}
+
+static void game_advance(f32 dt)
 {
 #ifdef FEATURE_DEV
     dt *= game.dt_scale;
@@ -751,86 +1469,14 @@ void game_update(f32 dt)
     switch (game.state) {
     case STATE_GAMEPLAY: {
         game.step_cooldown -= dt;
-        if (game.step_cooldown <= 0.0f) {
-            if (!ring_empty(&game.next_dirs)) {
-                if (dir_opposite(game.dir) != *ring_front(&game.next_dirs)) {
-                    game.dir = *ring_front(&game.next_dirs);
-                }
-                ring_pop_front(&game.next_dirs);
-            }
-
-            Cell next_head = step_cell(*ring_back(&game.snake), game.dir);
-
-            if (cell_eq(game.egg, next_head)) {
-                ring_push_back(&game.snake, next_head);
-                random_egg(FALSE);
-                game.eating_egg = TRUE;
-#ifdef FEATURE_DYNAMIC_CAMERA
-                game.infinite_field = TRUE;
-#endif
-                game.score += 1;
-                stbsp_snprintf(game.score_buffer, sizeof(game.score_buffer), "Score: %u", game.score);
-            } else {
-                i32 next_head_index = is_cell_snake_body(next_head);
-                if (next_head_index >= 0) {
-                    // NOTE: reseting step_cooldown to 0 is important bcause the whole smooth movement is based on it.
-                    // Without this reset the head of the snake "detaches" from the snake on the Game Over, when
-                    // step_cooldown < 0.0f
-                    game.step_cooldown = 0.0f;
-                    game.state = STATE_GAMEOVER;
-
-                    game.dead_snake.size = game.snake.size;
-                    Vec head_center = cell_center(next_head);
-                    for (u32 i = 0; i < game.snake.size; ++i) {
-#define GAMEOVER_EXPLOSION_RADIUS 1000.0f
-#define GAMEOVER_EXPLOSION_MAX_VEL 200.0f
-                        Cell cell = *ring_get(&game.snake, i);
-                        game.dead_snake.items[i] = cell_rect(cell);
-                        if (!cell_eq(cell, next_head)) {
-                            Vec vel_vec = vec_sub(cell_center(cell), head_center);
-                            f32 vel_len = vec_len(vel_vec);
-                            f32 t = ilerpf(0.0f, GAMEOVER_EXPLOSION_RADIUS, vel_len);
-                            if (t > 1.0f) t = 1.0f;
-                            t = 1.0f - t;
-                            f32 noise_x = (rand()%1000)*0.01;
-                            f32 noise_y = (rand()%1000)*0.01;
-                            vel_vec.x = vel_vec.x/vel_len*GAMEOVER_EXPLOSION_MAX_VEL*t + noise_x;
-                            vel_vec.y = vel_vec.y/vel_len*GAMEOVER_EXPLOSION_MAX_VEL*t + noise_y;
-                            game.dead_snake.vels[i] = vel_vec;
-                            // TODO: additional velocities along the body of the dead snake
-                        } else {
-                            game.dead_snake.vels[i].x = 0;
-                            game.dead_snake.vels[i].y = 0;
-                        }
-
-                        // @tail-ignore
-                        if (i > 0) {
-                            game.dead_snake.masks[i] = 0;
-                            if (i > 1) {
-                                game.dead_snake.masks[i] |= 1 << cells_dir(cell, *ring_get(&game.snake, i - 1));
-                            }
-                            if (i < game.snake.size - 1) {
-                                game.dead_snake.masks[i] |= 1 << cells_dir(cell, *ring_get(&game.snake, i + 1));
-                            }
-                        }
-                        if (i == game.snake.size - 1) {
-                            game.dead_snake.masks[i] |= 1 << game.dir;
-                        }
-                    }
-
-                    game.dead_snake.masks[next_head_index] |= 1 << cells_dir(
-                                *ring_get(&game.snake, next_head_index),
-                                *ring_get(&game.snake, game.snake.size - 1));
-
-                    return;
-                } else {
-                    ring_push_back(&game.snake, next_head);
-                    ring_pop_front(&game.snake);
-                    game.eating_egg = FALSE;
-                }
-            }
-
-            game.step_cooldown = STEP_INTEVAL;
+        // NOTE: a long frame performs all the steps it covers instead of slowing the snake down
+        while (game.step_cooldown <= 0.0f) {
+            TRACE_BEGIN("step");
+            DEV_COUNT_STEP();
+            b32 alive = game_step();
+            TRACE_END();
+            if (!alive) return;
+            game.step_cooldown += STEP_INTEVAL;
         }
     }
     break;
@@ -839,13 +1485,9 @@ void game_update(f32 dt)
     {} break;
 
     case STATE_GAMEOVER: {
-        // @tail-ignore
-        for (u32 i = 1; i < game.dead_snake.size; ++i) {
-            game.dead_snake.vels[i].x *= 0.99f;
-            game.dead_snake.vels[i].y *= 0.99f;
-            game.dead_snake.items[i].x += game.dead_snake.vels[i].x*dt;
-            game.dead_snake.items[i].y += game.dead_snake.vels[i].y*dt;
-        }
+        TRACE_BEGIN("dead_snake_update");
+        dead_snake_update(dt);
+        TRACE_END();
     }
     break;
 
@@ -855,6 +1497,344 @@ void game_update(f32 dt)
     }
 }
 
+static Input_Ring input_ring = {0};
+static f64 input_clock = 0.0;
+
+Input_Ring *game_input_ring(void)
+{
+    return &input_ring;
+}
+
+void game_input(f64 time, int key)
+{
+    if (input_ring.size >= ring_cap(&input_ring)) {
+        // NOTE: the platform is not calling game_update() often enough, apply the oldest event right away
+        keydown_time = ring_front(&input_ring)->time;
+        game_keydown(ring_front(&input_ring)->key);
+        keydown_time = -1.0;
+        ring_pop_front(&input_ring);
+    }
+    Input_Event event = {.time = time, .key = key};
+    ring_push_back(&input_ring, event);
+}
+
+void game_update(f32 dt)
+{
+    TRACE_BEGIN("game_update");
+    f64 frame_end = input_clock + dt;
+    update_end_time = frame_end;
+    while (!ring_empty(&input_ring) && ring_front(&input_ring)->time <= frame_end) {
+        Input_Event event = *ring_front(&input_ring);
+        ring_pop_front(&input_ring);
+        if (event.time > input_clock) {
+            game_advance(event.time - input_clock);
+            input_clock = event.time;
+        }
+        TRACE_BEGIN("input");
+        keydown_time = event.time;
+        game_keydown(event.key);
+        keydown_time = -1.0;
+        TRACE_END();
+    }
+    game_advance(frame_end - input_clock);
+    input_clock = frame_end;
+
+#ifdef FEATURE_DEV
+    Dev_Frame frame = {.dt = dt, .steps = dev_hud.steps};
+    ring_displace_back(&dev_hud.frames, frame);
+    dev_hud.steps = 0;
+#endif
+    TRACE_END();
+}
+
+// Recording and replay
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+static u64 hash_bytes(u64 hash, const void *data, u32 size)
+{
+    const u8 *bytes = data;
+    for (u32 i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// The state a replay reproduces: everything but what depends on the frame timings (the camera,
+// the phase of the current step and the fragments of the dead snake flying apart)
+static u64 game_state_hash(void)
+{
+    u64 hash = FNV_OFFSET;
+    hash = hash_bytes(hash, &sim_tick, sizeof(sim_tick));
+    hash = hash_bytes(hash, &rand_state, sizeof(rand_state));
+    hash = hash_bytes(hash, &game.state, sizeof(game.state));
+    for (u32 i = 0; i < game.snake.size; ++i) {
+        hash = hash_bytes(hash, ring_get(&game.snake, i), sizeof(Cell));
+    }
+    hash = hash_bytes(hash, &game.egg, sizeof(game.egg));
+    hash = hash_bytes(hash, &game.eating_egg, sizeof(game.eating_egg));
+    hash = hash_bytes(hash, &game.dir, sizeof(game.dir));
+    for (u32 i = 0; i < game.next_dirs.size; ++i) {
+        hash = hash_bytes(hash, &ring_get(&game.next_dirs, i)->dir, sizeof(Dir));
+    }
+    hash = hash_bytes(hash, &game.score, sizeof(game.score));
+    return hash;
+}
+
+u64 game_replay_hash(void)
+{
+    u64 hash = game_state_hash();
+    hash = hash_bytes(hash, &game.step_cooldown, sizeof(game.step_cooldown));
+    hash = hash_bytes(hash, &game.camera_pos, sizeof(game.camera_pos));
+    hash = hash_bytes(hash, &game.camera_vel, sizeof(game.camera_vel));
+    if (game.state == STATE_GAMEOVER) {
+        hash = hash_bytes(hash, &game.dead_snake.size, sizeof(game.dead_snake.size));
+        hash = hash_bytes(hash, game.dead_snake.items, game.dead_snake.size*sizeof(Rect));
+        hash = hash_bytes(hash, game.dead_snake.vels, game.dead_snake.size*sizeof(Vec));
+        hash = hash_bytes(hash, game.dead_snake.masks, game.dead_snake.size*sizeof(u8));
+    }
+    return hash;
+}
+
+u32 game_replay_tick(void)
+{
+    return sim_tick;
+}
+
+static u32 replay_read_u32(u32 at)
+{
+    u32 x = 0;
+    for (u32 i = 0; i < 4; ++i) x |= (u32)replay_buffer[at + i] << i*8;
+    return x;
+}
+
+static u64 replay_read_u64(u32 at)
+{
+    return replay_read_u32(at) | (u64)replay_read_u32(at + 4) << 32;
+}
+
+static b32 replay_read_varint(u32 *x)
+{
+    *x = 0;
+    for (u32 shift = 0; shift < 32; shift += 7) {
+        if (replay.cursor >= replay.events_end) return FALSE;
+        u8 byte = replay_buffer[replay.cursor++];
+        *x |= (u32)(byte&0x7F) << shift;
+        if ((byte&0x80) == 0) return TRUE;
+    }
+    return FALSE;
+}
+
+// Reads ahead the next event skipping the keyframes, has_event is FALSE at the end of the records
+static void replay_read_event(void)
+{
+    for (;;) {
+        u32 delta, key;
+        replay.has_event = replay_read_varint(&delta) && replay_read_varint(&key);
+        if (!replay.has_event) return;
+        replay.event_tick += delta;
+        if (key != REPLAY_KEYFRAME) {
+            replay.event_key = key - 1;
+            replay.count += 1;
+            return;
+        }
+        u32 size;
+        if (!replay_read_varint(&size) || size > replay.events_end - replay.cursor) {
+            replay.has_event = FALSE;
+            return;
+        }
+        replay.cursor += size;
+    }
+}
+
+// Builds the index at the end of the recording: the keyframe to start from for every
+// keyframe_interval ticks, which is the last one at or before that tick (0 is the header). A step
+// that ends the game does not produce a keyframe, the tick reuses the previous one.
+static void replay_write_index(void)
+{
+    replay.events_end = replay.size;
+    replay.cursor = REPLAY_HEADER_SIZE;
+    u32 tick = 0;
+    u32 keyframe = 0;
+    u32 index = 0;
+    u32 delta, key, size;
+    while (replay_read_varint(&delta) && replay_read_varint(&key)) {
+        tick += delta;
+        if (key != REPLAY_KEYFRAME) continue;
+        if (!replay_read_varint(&size)) break;
+        for (; index < tick/REPLAY_KEYFRAME_INTERVAL; ++index) replay_write_u32(keyframe);
+        keyframe = replay.cursor;
+        replay.cursor += size;
+    }
+    for (; index <= sim_tick/REPLAY_KEYFRAME_INTERVAL; ++index) replay_write_u32(keyframe);
+    replay.index_count = index;
+}
+
+// Restarts the game the way the recording started
+static void replay_rewind(void)
+{
+    replay.cursor     = REPLAY_HEADER_SIZE;
+    replay.count      = 0;
+    replay.event_tick = 0;
+    replay.gameover_frames = 0;
+    rand_state = replay_read_u64(16);
+    sim_tick = 0;
+    game_restart(replay_read_u32(8), replay_read_u32(12));
+}
+
+static b32 replay_load_keyframe(u32 at)
+{
+    Snapshot snapshot;
+    if (at > replay.events_end || replay.events_end - at < 4 + sizeof(snapshot)) return FALSE;
+    rt_memcpy(&snapshot, &replay_buffer[at + 4], sizeof(snapshot));
+    if (snapshot.snake_size == 0 || snapshot.snake_size > SNAKE_CAP) return FALSE;
+    if (snapshot.next_dirs_size > DIR_QUEUE_CAP || snapshot.state > STATE_GAMEOVER) return FALSE;
+    if (snapshot.dir >= COUNT_DIRS) return FALSE;
+    for (u32 i = 0; i < snapshot.next_dirs_size; ++i) {
+        if (snapshot.next_dirs[i] >= COUNT_DIRS) return FALSE;
+    }
+    u32 cells_size = snapshot.snake_size*sizeof(Cell);
+    if (replay.events_end - at - 4 - sizeof(snapshot) < cells_size) return FALSE;
+    u32 end = at + 4 + sizeof(snapshot) + cells_size;
+
+    game_snapshot_restore(&replay_buffer[at + 4]);
+    // NOTE: keyframes are taken in the middle of game_advance(), see game_replay_step()
+    game.step_cooldown = STEP_INTEVAL;
+    replay.count      = replay_read_u32(at);
+    replay.event_tick = sim_tick;
+    replay.cursor     = end;
+    return TRUE;
+}
+
+u8 *game_replay_buffer(void)
+{
+    return replay_buffer;
+}
+
+void game_record_begin(void)
+{
+    rt_memset(&replay, 0, sizeof(replay));
+    replay.recording = TRUE;
+    replay_write_u32(REPLAY_MAGIC);
+    replay_write_u32(REPLAY_VERSION);
+    replay_write_u32(game.width);
+    replay_write_u32(game.height);
+    replay_write_u64(rand_state);
+    sim_tick = 0;
+    game_restart(game.width, game.height);
+}
+
+u32 game_record_end(void)
+{
+    if (!replay.recording) return 0;
+    replay.recording = FALSE;
+    if (replay.size > REPLAY_CAP) return 0;
+    replay_write_index();
+    replay_write_u32(replay.count);
+    replay_write_u32(sim_tick);
+    replay_write_u64(game_state_hash());
+    replay_write_u32(REPLAY_KEYFRAME_INTERVAL);
+    replay_write_u32(replay.index_count);
+    if (replay.size > REPLAY_CAP) return 0;
+    return replay.size;
+}
+
+b32 game_replay_begin(u32 size)
+{
+    rt_memset(&replay, 0, sizeof(replay));
+    if (size < REPLAY_HEADER_SIZE + REPLAY_FOOTER_SIZE || size > REPLAY_CAP) return FALSE;
+    if (replay_read_u32(0) != REPLAY_MAGIC || replay_read_u32(4) != REPLAY_VERSION) return FALSE;
+
+    u32 footer = size - REPLAY_FOOTER_SIZE;
+    replay.final_tick        = replay_read_u32(footer + 4);
+    replay.final_hash        = replay_read_u64(footer + 8);
+    replay.keyframe_interval = replay_read_u32(footer + 16);
+    replay.index_count       = replay_read_u32(footer + 20);
+    if (replay.keyframe_interval == 0 || replay.index_count == 0) return FALSE;
+    if (replay.index_count > (footer - REPLAY_HEADER_SIZE)/4) return FALSE;
+    replay.size       = size;
+    replay.events_end = footer - replay.index_count*4;
+
+    replay_rewind();
+    replay.replaying = TRUE;
+    replay_read_event();
+    return TRUE;
+}
+
+b32 game_replay_seek(u32 tick)
+{
+    if (replay.keyframe_interval == 0) return FALSE;
+    if (tick > replay.final_tick) tick = replay.final_tick;
+
+    u32 index = tick/replay.keyframe_interval;
+    if (index >= replay.index_count) index = replay.index_count - 1;
+    u32 keyframe = replay_read_u32(replay.events_end + index*4);
+
+    replay_rewind();
+    if (keyframe != 0 && !replay_load_keyframe(keyframe)) return FALSE;
+    replay.replaying = TRUE;
+    replay_read_event();
+
+    // NOTE: at most keyframe_interval ticks unless the game was over right at the keyframes
+    while (sim_tick < tick && game_replay_step()) {}
+    return sim_tick == tick;
+}
+
+// NOTE: the same path as game_update() so the float code of a frame (the camera) runs too
+static void replay_advance(f32 dt)
+{
+#ifdef FEATURE_DEV
+    f32 dt_scale = game.dt_scale;
+    game.dt_scale = 1.0f;
+#endif
+    game_advance(dt);
+#ifdef FEATURE_DEV
+    game.dt_scale = dt_scale;
+#endif
+}
+
+b32 game_replay_step(void)
+{
+    if (!replay.replaying) return FALSE;
+
+    if (game.state == STATE_GAMEOVER && replay.gameover_frames < REPLAY_GAMEOVER_FRAMES) {
+        replay_advance(REPLAY_GAMEOVER_DT);
+        replay.gameover_frames += 1;
+        return TRUE;
+    }
+    replay.gameover_frames = 0;
+
+    while (replay.has_event && replay.event_tick == sim_tick) {
+        game_keydown(replay.event_key);
+        replay_read_event();
+    }
+
+    // NOTE: the snake only steps during the gameplay. In a valid recording the keys that get back
+    // to it (unpausing, restarting after the Game Over) come at the same tick as the ones leaving it.
+    if (sim_tick >= replay.final_tick || game.state != STATE_GAMEPLAY) {
+        replay.replaying = FALSE;
+        return FALSE;
+    }
+
+    // NOTE: starting right at the beginning of a step, STEP_INTEVAL of time is exactly one step
+    game.step_cooldown = STEP_INTEVAL;
+    replay_advance(STEP_INTEVAL);
+    return TRUE;
+}
+
+b32 game_replay_verify(void)
+{
+    return replay.keyframe_interval != 0
+        && !replay.replaying
+        && !replay.has_event
+        && replay.cursor == replay.events_end
+        && replay.count == replay_read_u32(replay.size - REPLAY_FOOTER_SIZE)
+        && sim_tick == replay.final_tick
+        && game_state_hash() == replay.final_hash;
+}
+
 // TODO: inifinite field mechanics
 // TODO: starvation mechanics
 // TODO: bug on wrapping around when eating the first egg
@@ -9,6 +9,7 @@ typedef unsigned long long u64;
 typedef int i32;
 typedef int b32;
 typedef float f32;
+typedef double f64;
 
 void platform_fill_rect(i32 x, i32 y, i32 w, i32 h, u32 color);
 void platform_stroke_rect(i32 x, i32 y, i32 w, i32 h, u32 color);
@@ -16,11 +17,154 @@ void platform_fill_text(i32 x, i32 y, const char *text, u32 size, u32 color);
 u32 platform_text_width(const char *text, u32 size);
 void platform_panic(const char *file_path, i32 line, const char *message);
 void platform_log(const char *message);
+// Monotonic clock in nanoseconds, only used for tracing
+u64 platform_now_ns(void);
 
 void game_init(u32 width, u32 height);
 void game_resize(u32 width, u32 height);
 void game_render(void);
+// NOTE: the platforms clamp dt to FRAME_MAX_DT, longer frames (debugger, dragging the window) are
+// not caught up
 void game_update(f32 dt);
 void game_keydown(int key);
 
+// Input events queued by the platform and consumed by game_update() at the moment they happened.
+// The time is in seconds on the clock the platform derives the game_update() dt from, where 0 is
+// the moment right before the first game_update() call.
+typedef struct {
+    f64 time;
+    i32 key;
+} Input_Event;
+
+#define INPUT_RING_CAP 64
+typedef struct {
+    u32 begin;
+    u32 size;
+    Input_Event items[INPUT_RING_CAP];
+} Input_Ring;
+
+// The platform may append to the ring directly (items[(begin + size)%INPUT_RING_CAP], then size += 1)
+// or go through game_input() which also handles the ring being full.
+Input_Ring *game_input_ring(void);
+void game_input(f64 time, int key);
+
+// Trace zones recorded by the game when it is compiled with FEATURE_TRACE (on in the dev builds).
+// The ring keeps the most recent TRACE_RING_CAP zones, the oldest ones are overwritten. Times come
+// from platform_now_ns(), depth is the nesting level of the zone.
+typedef struct {
+    u64 begin_ns;
+    u64 end_ns;
+    const char *name;
+    u32 depth;
+} Trace_Zone;
+
+#define TRACE_RING_CAP 4096
+typedef struct {
+    u32 begin;
+    u32 size;
+    Trace_Zone items[TRACE_RING_CAP];
+} Trace_Ring;
+
+// NULL when the game is compiled without FEATURE_TRACE
+Trace_Ring *game_trace_ring(void);
+
+// Log entries recorded by LOGF() in the dev builds. Nothing is formatted when logging: an entry is
+// the format string (a static string of the game), platform_now_ns() and the raw arguments, which
+// are integers sign-extended to 64 bits, floats as the bits of an f64 and strings as pointers
+// (static strings only, they are read when the entry is formatted). The ring keeps the most recent
+// LOG_RING_CAP entries.
+#define LOG_MAX_ARGS 4
+typedef struct {
+    u64 time_ns;
+    const char *fmt;
+    u32 nargs;
+    u64 args[LOG_MAX_ARGS];
+} Log_Entry;
+
+#define LOG_RING_CAP 256
+typedef struct {
+    u32 begin;
+    u32 size;
+    Log_Entry items[LOG_RING_CAP];
+} Log_Ring;
+
+// NULL in the release builds. A platform that formats the entries itself takes them out (size = 0).
+Log_Ring *game_log_ring(void);
+// Formats the pending entries and passes them to platform_log(). Call it outside of the frame
+// timings, formatting is exactly what the ring keeps off the hot path.
+void game_log_flush(void);
+
+// A turn of the snake caused by an input event that went through game_input(). Both times are on
+// the input clock (see Input_Event): when the input happened and the end of the game_update() that
+// changed the direction.
+typedef struct {
+    f64 input_time;
+    f64 consume_time;
+} Latency_Sample;
+
+#define LATENCY_RING_CAP 16
+typedef struct {
+    u32 begin;
+    u32 size;
+    Latency_Sample items[LATENCY_RING_CAP];
+} Latency_Ring;
+
+// The turns that the last game_render() shows for the first time. The platform takes them out
+// (size = 0) once that frame is presented, the remaining ones are overwritten by the next frames.
+Latency_Ring *game_latency_ring(void);
+
+// Snapshots of the simulation state for search and rollback, at most GAME_SNAPSHOT_CAP bytes.
+// Restoring keeps the board size and drops the fragments of the dead snake.
+// NOTE: recordings keep snapshots as is, the layout is fixed (Snapshot in game.c, then the cells)
+#define GAME_SNAPSHOT_CAP 2048
+u32 game_snapshot_size(void);
+// Returns the number of bytes written, which is game_snapshot_size()
+u32 game_snapshot_save(void *buffer);
+void game_snapshot_restore(const void *buffer);
+// GAME_SNAPSHOT_CAP bytes in the game memory for the hosts that can not pass their own buffer (wasm)
+u8 *game_snapshot_buffer(void);
+// Writes a snapshot of a snake of `len` cells laid over the board row by row and heading for the next
+// free cell, with the egg in the last cell of the board, for benchmarks and goldens that need a long
+// snake without playing for it. `len` is clamped to leave that cell free. Returns the size.
+u32 game_snapshot_serpentine(void *buffer, u32 len);
+
+// Recording of a session for deterministic replays. A recording is the state of the RNG and the
+// board it started with followed by every key passed to game_keydown() stamped with the simulation
+// tick it arrived at (the number of snake steps since the start). Frame timings are not recorded:
+// a replay feeds the keys back at the same ticks and performs the steps one by one, so it ends up
+// in the identical state at any speed. Every REPLAY_KEYFRAME_INTERVAL ticks (see game.c) the
+// recording also keeps a keyframe (the event count so far and a snapshot), and the index at the end
+// points at the keyframe to start from for each interval, so seeking anywhere restores one
+// keyframe and simulates at most an interval of ticks. Little-endian, varints are LEB128:
+//   header    u32 magic "SNKR", u32 version, u32 width, u32 height, u64 RNG state
+//   records   varint ticks since the previous record, then
+//               varint key + 1                       an event
+//               varint 0, varint size, size bytes    a keyframe: u32 event count, snapshot
+//   index     u32 offset of the keyframe (0 for none, start from the header) per interval
+//   footer    u32 event count, u32 final tick, u64 hash of the final state,
+//             u32 keyframe interval, u32 index count
+#define REPLAY_CAP (256*1024)
+
+// REPLAY_CAP bytes in the game memory, the recording is written here and a replay is read from here
+u8 *game_replay_buffer(void);
+// Restarts the game and starts recording it
+void game_record_begin(void);
+// Finishes the recording, returns its size in game_replay_buffer() or 0 if it did not fit
+u32 game_record_end(void);
+// Restarts the game as the recording of the given size in game_replay_buffer() started. FALSE if
+// the data is not a recording.
+b32 game_replay_begin(u32 size);
+// Restarts the replay at the given tick (the end of the recording at most), before the keys of
+// that tick are applied. FALSE if it could not get there.
+b32 game_replay_seek(u32 tick);
+// Performs one tick of the replay (or a frame of the Game Over after a death), FALSE once the end
+// of the recording is reached
+b32 game_replay_step(void);
+// Whether the replay reached the end of the recording in the state the recording ended in
+b32 game_replay_verify(void);
+// The current tick and a hash of the whole state at it, floats included, to find where two builds
+// diverge on the same recording (see hash_diff.js)
+u32 game_replay_tick(void);
+u64 game_replay_hash(void);
+
 #endif // GAME_H_
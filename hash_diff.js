@@ -0,0 +1,51 @@
+'use strict';
+
+// Compares two per-tick state hash traces of the same replay and reports the first tick where they
+// diverge:
+//   $ ./headless_main --replay session.rec --hash-trace native.txt
+//   $ node wasm_headless.js --replay session.rec --hash-trace wasm.txt
+//   $ node hash_diff.js native.txt wasm.txt
+// Every line of a trace is `<tick> <hash>`, one for the starting state and one after every
+// game_replay_step(), the Game Over frames after a death repeat its tick. The traces are compared
+// line by line, so both must start at the same tick (the same --seek). Exits with 1 if they diverge.
+
+const fs = require('fs');
+
+function usage() {
+    console.error("Usage: node hash_diff.js <a.txt> <b.txt>");
+    process.exit(1);
+}
+
+function parse_trace(file_path) {
+    return fs.readFileSync(file_path, 'utf8').split('\n').flatMap((line, index) => {
+        line = line.trim();
+        if (line.length == 0 || line.startsWith('#')) return [];
+        const [tick, hash] = line.split(/\s+/);
+        if (!/^\d+$/.test(tick) || !/^[0-9a-f]{16}$/.test(hash)) {
+            throw new Error(`${file_path}:${index + 1}: expected \`<tick> <hash>\``);
+        }
+        return [{tick: parseInt(tick), hash}];
+    });
+}
+
+if (process.argv.length != 4) usage();
+const [a_path, b_path] = process.argv.slice(2);
+const a = parse_trace(a_path);
+const b = parse_trace(b_path);
+
+const n = Math.min(a.length, b.length);
+for (let i = 0; i < n; ++i) {
+    if (a[i].tick != b[i].tick || a[i].hash != b[i].hash) {
+        console.log(`first divergence at line ${i + 1}, tick ${a[i].tick}:`);
+        console.log(`    ${a_path.padEnd(24)} ${a[i].tick} ${a[i].hash}`);
+        console.log(`    ${b_path.padEnd(24)} ${b[i].tick} ${b[i].hash}`);
+        if (i > 0) console.log(`last matching tick ${a[i - 1].tick}`);
+        process.exit(1);
+    }
+}
+if (a.length != b.length) {
+    const [longer, path] = a.length > b.length ? [a, a_path] : [b, b_path];
+    console.log(`identical for ${n} lines, then ${path} goes on from tick ${longer[n].tick}`);
+    process.exit(1);
+}
+console.log(`identical: ${n} lines, ticks ${n > 0 ? a[0].tick : 0}..${n > 0 ? a[n - 1].tick : 0}`);
@@ -0,0 +1,682 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+
+// Runs the game without a window, records everything it draws and reports how long it took:
+//   $ ./headless_main [--frames 3600] [--dt 0.016666] [--size 1600x900] [--random SEED] [--log commands.bin] [--trace trace.json] [--record session.rec] [input.txt]
+//   $ ./headless_main --replay session.rec [--seek TICK] [--hash-trace hashes.txt]
+//
+// The input file has the same format wasm_headless.js reads: one `<frame> <key>` per line, where
+// <key> is a single character or `space`, and lines starting with # are ignored. --random feeds
+// a pseudo random stream of keys instead. --trace dumps the trace zones the game recorded (the most
+// recent TRACE_RING_CAP of them) as Chrome trace JSON, see chrome://tracing or ui.perfetto.dev.
+//
+// --record writes the session as a recording of the game and `--replay FILE` plays one back instead,
+// see Recording and replay below.
+//
+// `--golden golden.txt` runs the built-in scenarios instead and checks their draw calls and command
+// streams against the golden file, see Golden command streams below.
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--frames N] [--dt SECONDS] [--size WxH] [--random SEED] [--log FILE] [--trace FILE] [--record FILE] [input.txt]\n", program);
+    fprintf(stderr, "       %s --replay FILE [--seek TICK] [--hash-trace FILE]\n", program);
+    fprintf(stderr, "       %s --golden FILE [--golden-update]\n", program);
+    exit(1);
+}
+
+// Command log
+//
+// Every command is a u32 kind followed by its arguments as u32s in host byte order. Text is a u32
+// length followed by the bytes without the NUL. A frame starts with CMD_FRAME followed by the
+// frame index.
+typedef enum {
+    CMD_FRAME,
+    CMD_FILL_RECT,
+    CMD_STROKE_RECT,
+    CMD_FILL_TEXT,
+    COUNT_CMDS,
+} Command_Kind;
+
+typedef struct {
+    size_t fill_rect;
+    size_t stroke_rect;
+    size_t fill_text;
+    size_t text_width;
+    size_t log;
+} Platform_Calls;
+
+static Platform_Calls calls = {0};
+static FILE *command_log = NULL;
+
+// FNV-1a of the commands in the command log format, only while command_hashing is set
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+static bool command_hashing = false;
+static u64 command_hash = FNV_OFFSET;
+
+static void command_hash_bytes(const void *data, size_t n)
+{
+    if (!command_hashing) return;
+    const u8 *bytes = data;
+    for (size_t i = 0; i < n; ++i) {
+        command_hash = (command_hash ^ bytes[i])*FNV_PRIME;
+    }
+}
+
+static void command_log_u32s(const u32 *xs, size_t n)
+{
+    command_hash_bytes(xs, n*sizeof(*xs));
+    if (command_log == NULL) return;
+    fwrite(xs, sizeof(*xs), n, command_log);
+}
+
+static void command_log_text(const char *text)
+{
+    u32 n = strlen(text);
+    command_log_u32s(&n, 1);
+    command_hash_bytes(text, n);
+    if (command_log == NULL) return;
+    fwrite(text, 1, n, command_log);
+}
+
+void platform_fill_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
+{
+    calls.fill_rect += 1;
+    u32 command[] = {CMD_FILL_RECT, x, y, w, h, color};
+    command_log_u32s(command, sizeof(command)/sizeof(command[0]));
+}
+
+void platform_stroke_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
+{
+    calls.stroke_rect += 1;
+    u32 command[] = {CMD_STROKE_RECT, x, y, w, h, color};
+    command_log_u32s(command, sizeof(command)/sizeof(command[0]));
+}
+
+void platform_fill_text(i32 x, i32 y, const char *text, u32 size, u32 color)
+{
+    calls.fill_text += 1;
+    u32 command[] = {CMD_FILL_TEXT, x, y, size, color};
+    command_log_u32s(command, sizeof(command)/sizeof(command[0]));
+    command_log_text(text);
+}
+
+u32 platform_text_width(const char *text, u32 size)
+{
+    calls.text_width += 1;
+    // NOTE: a fixed advance per character, the same one wasm_headless.js uses
+    return strlen(text)*size/2;
+}
+
+void platform_panic(const char *file_path, i32 line, const char *message)
+{
+    fprintf(stderr, "%s:%d: GAME ASSERTION FAILED: %s\n", file_path, line, message);
+    abort();
+}
+
+void platform_log(const char *message)
+{
+    calls.log += 1;
+    printf("[LOG] %s\n", message);
+}
+
+u64 platform_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec*1000*1000*1000 + ts.tv_nsec;
+}
+
+// Input
+
+typedef struct {
+    size_t frame;
+    int key;
+} Scripted_Key;
+
+typedef struct {
+    Scripted_Key *items;
+    size_t count;
+    size_t capacity;
+} Scripted_Keys;
+
+static bool parse_input(const char *file_path, Scripted_Keys *keys)
+{
+    FILE *f = fopen(file_path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open %s\n", file_path);
+        return false;
+    }
+
+    char line[256];
+    for (size_t row = 1; fgets(line, sizeof(line), f) != NULL; ++row) {
+        char *s = line;
+        while (*s == ' ' || *s == '\t') s++;
+        if (*s == '#' || *s == '\n' || *s == '\r' || *s == '\0') continue;
+
+        size_t frame = 0;
+        char key_str[16] = {0};
+        if (sscanf(s, "%zu %15s", &frame, key_str) != 2 ||
+            (strlen(key_str) != 1 && strcmp(key_str, "space") != 0)) {
+            fprintf(stderr, "%s:%zu: expected `<frame> <key>`\n", file_path, row);
+            fclose(f);
+            return false;
+        }
+
+        if (keys->count >= keys->capacity) {
+            keys->capacity = keys->capacity == 0 ? 64 : keys->capacity*2;
+            keys->items = realloc(keys->items, keys->capacity*sizeof(*keys->items));
+            assert(keys->items != NULL && "Buy more RAM lol");
+        }
+        keys->items[keys->count++] = (Scripted_Key) {
+            .frame = frame,
+            .key = strcmp(key_str, "space") == 0 ? ' ' : key_str[0],
+        };
+    }
+
+    fclose(f);
+    return true;
+}
+
+// NOTE: xorshift64, the sequence only depends on the seed so a run can be reproduced
+static u64 random_state = 0;
+
+static u64 random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+#define RANDOM_KEY_CHANCE 8 // on average one key every RANDOM_KEY_CHANCE frames
+
+static int random_key(void)
+{
+    if (random_next()%RANDOM_KEY_CHANCE != 0) return 0;
+    // Mostly turns with an occasional pause/unpause, also restarts the game after a game over
+    const char *keys = "wasdwasdwasdwasd ";
+    return keys[random_next()%strlen(keys)];
+}
+
+// Trace
+
+static bool trace_dump(const char *file_path)
+{
+    const Trace_Ring *ring = game_trace_ring();
+    if (ring == NULL) {
+        fprintf(stderr, "ERROR: the game is compiled without FEATURE_TRACE\n");
+        return false;
+    }
+
+    FILE *f = fopen(file_path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open %s\n", file_path);
+        return false;
+    }
+
+    // NOTE: Chrome trace timestamps are in microseconds, make them relative to the earliest zone.
+    // Zones are recorded when they end, so that is not necessarily the first one in the ring.
+    u64 origin = (u64)-1;
+    for (u32 i = 0; i < ring->size; ++i) {
+        const Trace_Zone *zone = &ring->items[(ring->begin + i)%TRACE_RING_CAP];
+        if (zone->begin_ns < origin) origin = zone->begin_ns;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (u32 i = 0; i < ring->size; ++i) {
+        const Trace_Zone *zone = &ring->items[(ring->begin + i)%TRACE_RING_CAP];
+        fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":0,\"args\":{\"depth\":%u}}\n",
+                i == 0 ? "" : ",", zone->name,
+                (zone->begin_ns - origin)/1000.0, (zone->end_ns - zone->begin_ns)/1000.0, zone->depth);
+    }
+    fprintf(f, "],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(f);
+
+    printf("trace: %s (%u zones)\n", file_path, ring->size);
+    return true;
+}
+
+// Golden command streams
+//
+// Deterministic scenarios played through the public game API. The command stream of the last
+// game_render() of each one is hashed and its draw calls (fill_rect + stroke_rect + fill_text)
+// counted. The golden file has a `<scenario> <draw calls> <budget> <hash>` line per scenario and
+// # comments. The check fails if a scenario draws more than its budget or its stream changed.
+// --golden-update rewrites the file with the current draw calls and hashes, keeping the budgets
+// (a new scenario gets its current draw calls plus GOLDEN_BUDGET_HEADROOM).
+//
+// NOTE: the scenarios share the state of the game's rand(), so they always run all in this order.
+// The release build draws no dev overlays, it has its own golden file (see build.sh).
+// The hashes depend on the float math of the build, compare them with the same compiler and target.
+
+#define GOLDEN_WIDTH 1600
+#define GOLDEN_HEIGHT 900
+#define GOLDEN_STEP_INTEVAL 0.125f // STEP_INTEVAL of game.c, one game_update() is one step
+#define GOLDEN_FRAME_DT (1.0f/60.0f)
+#define GOLDEN_BUDGET_HEADROOM(draw_calls) ((draw_calls) + (draw_calls)/8)
+
+static void golden_steps(u32 n)
+{
+    for (u32 i = 0; i < n; ++i) game_update(GOLDEN_STEP_INTEVAL);
+}
+
+static void scenario_start(void)
+{
+    game_update(GOLDEN_FRAME_DT);
+}
+
+#define GOLDEN_SNAKE_LEN 100 // the head is in the middle of a row, see scenario_gameover()
+
+static void scenario_long_snake(void)
+{
+    game_snapshot_serpentine(game_snapshot_buffer(), GOLDEN_SNAKE_LEN);
+    game_snapshot_restore(game_snapshot_buffer());
+    game_update(GOLDEN_FRAME_DT);
+}
+
+static void scenario_wrap_around(void)
+{
+    // The snake starts in the middle row, a few steps up take its head over the top edge
+    game_keydown('w');
+    golden_steps(5);
+    game_update(GOLDEN_STEP_INTEVAL*0.5f);
+}
+
+static void scenario_pause(void)
+{
+    golden_steps(3);
+    game_keydown(' ');
+    game_update(GOLDEN_FRAME_DT);
+}
+
+static void scenario_gameover(void)
+{
+    game_snapshot_serpentine(game_snapshot_buffer(), GOLDEN_SNAKE_LEN);
+    game_snapshot_restore(game_snapshot_buffer());
+    // Turning up in the middle of a row bites the row laid just before, the snapshot is in the
+    // middle of a step so one more step is due
+    game_keydown('w');
+    golden_steps(1);
+    for (u32 i = 0; i < 60; ++i) game_update(GOLDEN_FRAME_DT);
+}
+
+typedef struct {
+    const char *name;
+    void (*play)(void);
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"start",       scenario_start},
+    {"long_snake",  scenario_long_snake},
+    {"wrap_around", scenario_wrap_around},
+    {"pause",       scenario_pause},
+    {"gameover",    scenario_gameover},
+};
+#define SCENARIOS_COUNT (sizeof(scenarios)/sizeof(scenarios[0]))
+
+typedef struct {
+    bool present;
+    size_t draw_calls;
+    size_t budget;
+    u64 hash;
+} Golden;
+
+static bool golden_load(const char *file_path, Golden goldens[SCENARIOS_COUNT])
+{
+    FILE *f = fopen(file_path, "r");
+    // NOTE: a missing file is fine with --golden-update, it's created
+    if (f == NULL) return false;
+
+    char line[256];
+    for (size_t row = 1; fgets(line, sizeof(line), f) != NULL; ++row) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char name[64];
+        Golden golden = {.present = true};
+        if (sscanf(line, "%63s %zu %zu %llx", name, &golden.draw_calls, &golden.budget, &golden.hash) != 4) {
+            fprintf(stderr, "%s:%zu: expected `<scenario> <draw calls> <budget> <hash>`\n", file_path, row);
+            continue;
+        }
+        for (size_t i = 0; i < SCENARIOS_COUNT; ++i) {
+            if (strcmp(scenarios[i].name, name) == 0) goldens[i] = golden;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static int golden_run(const char *program, const char *file_path, bool update)
+{
+    Golden goldens[SCENARIOS_COUNT] = {0};
+    if (!golden_load(file_path, goldens) && !update) {
+        fprintf(stderr, "ERROR: could not open %s, create it with --golden-update\n", file_path);
+        return 1;
+    }
+
+    Golden actual[SCENARIOS_COUNT] = {0};
+    size_t failed = 0;
+    for (size_t i = 0; i < SCENARIOS_COUNT; ++i) {
+        game_init(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+        scenarios[i].play();
+        game_log_flush();
+
+        memset(&calls, 0, sizeof(calls));
+        command_hash = FNV_OFFSET;
+        command_hashing = true;
+        game_render();
+        command_hashing = false;
+
+        actual[i] = (Golden) {
+            .present = true,
+            .draw_calls = calls.fill_rect + calls.stroke_rect + calls.fill_text,
+            .budget = goldens[i].present ? goldens[i].budget : GOLDEN_BUDGET_HEADROOM(calls.fill_rect + calls.stroke_rect + calls.fill_text),
+            .hash = command_hash,
+        };
+
+        const char *status = "OK";
+        if (!goldens[i].present) {
+            status = "NEW";
+        } else if (actual[i].draw_calls > goldens[i].budget) {
+            status = "OVER BUDGET";
+        } else if (actual[i].hash != goldens[i].hash) {
+            status = "CHANGED";
+        }
+        if (strcmp(status, "OK") != 0) failed += 1;
+        printf("%-12s %5zu draw calls (budget %5zu, golden %5zu)  %016llx  %s\n",
+               scenarios[i].name, actual[i].draw_calls, actual[i].budget, goldens[i].draw_calls,
+               actual[i].hash, status);
+    }
+
+    if (update) {
+        FILE *f = fopen(file_path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "ERROR: could not open %s\n", file_path);
+            return 1;
+        }
+        fprintf(f, "# Generated by `%s --golden %s --golden-update`, the budgets are edited by hand.\n", program, file_path);
+        fprintf(f, "# <scenario> <draw calls> <budget> <hash>\n");
+        for (size_t i = 0; i < SCENARIOS_COUNT; ++i) {
+            fprintf(f, "%s %zu %zu %016llx\n", scenarios[i].name, actual[i].draw_calls, actual[i].budget, actual[i].hash);
+        }
+        fclose(f);
+        printf("golden: updated %s\n", file_path);
+        return 0;
+    }
+
+    if (failed > 0) {
+        fprintf(stderr, "ERROR: %zu of %zu scenarios do not match %s, rerun with --golden-update if the change is intended\n",
+                failed, SCENARIOS_COUNT, file_path);
+        return 1;
+    }
+    return 0;
+}
+
+// Stats
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_stats(const char *name, double *samples, size_t n)
+{
+    qsort(samples, n, sizeof(*samples), compare_doubles);
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += samples[i];
+    size_t p50 = n*50/100;
+    size_t p99 = n*99/100;
+    if (p99 >= n) p99 = n - 1;
+    printf("%-12s mean %7.0f ns  p50 %7.0f ns  p99 %7.0f ns\n", name, sum/n, samples[p50], samples[p99]);
+}
+
+// Recording and replay
+//
+// --record writes the session as a recording of the game (see game_record_begin() in game.h),
+// --replay plays one back at maximum speed, one tick after another without any frame timing, and
+// checks that it ends in the state the recording ended in. --seek starts it at the given tick from
+// the nearest keyframe instead. --hash-trace writes a `<tick> <hash>` line with game_replay_hash()
+// for the starting state and after every game_replay_step() (the Game Over frames after a death
+// repeat its tick), the same file wasm_headless.js writes for a module, compare them with
+// hash_diff.js.
+
+static bool record_save(const char *file_path)
+{
+    u32 size = game_record_end();
+    if (size == 0) {
+        fprintf(stderr, "ERROR: the recording does not fit into %u bytes\n", REPLAY_CAP);
+        return false;
+    }
+
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open %s\n", file_path);
+        return false;
+    }
+    fwrite(game_replay_buffer(), 1, size, f);
+    fclose(f);
+
+    printf("record: %s (%u bytes)\n", file_path, size);
+    return true;
+}
+
+static int replay_run(const char *file_path, long seek, const char *hash_trace_path)
+{
+    FILE *f = fopen(file_path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open %s\n", file_path);
+        return 1;
+    }
+    size_t size = fread(game_replay_buffer(), 1, REPLAY_CAP, f);
+    bool too_big = fgetc(f) != EOF;
+    fclose(f);
+    if (too_big || !game_replay_begin(size)) {
+        fprintf(stderr, "ERROR: %s is not a recording\n", file_path);
+        return 1;
+    }
+
+    if (seek >= 0) {
+        double start = now_ns();
+        bool ok = game_replay_seek(seek);
+        double seek_ns = now_ns() - start;
+        if (!ok) {
+            fprintf(stderr, "ERROR: could not seek %s to tick %ld\n", file_path, seek);
+            return 1;
+        }
+        printf("seek: tick %ld in %.0f ns\n", seek, seek_ns);
+    }
+
+    FILE *hash_trace = NULL;
+    if (hash_trace_path != NULL) {
+        hash_trace = fopen(hash_trace_path, "w");
+        if (hash_trace == NULL) {
+            fprintf(stderr, "ERROR: could not open %s\n", hash_trace_path);
+            return 1;
+        }
+        fprintf(hash_trace, "%u %016llx\n", game_replay_tick(), game_replay_hash());
+    }
+
+    size_t ticks = 0;
+    double update_ns = 0;
+    double render_ns = 0;
+    for (;;) {
+        double t0 = now_ns();
+        bool more = game_replay_step();
+        double t1 = now_ns();
+        game_render();
+        double t2 = now_ns();
+        update_ns += t1 - t0;
+        render_ns += t2 - t1;
+        game_log_flush();
+        if (!more) break;
+        if (hash_trace != NULL) fprintf(hash_trace, "%u %016llx\n", game_replay_tick(), game_replay_hash());
+        ticks += 1;
+    }
+
+    printf("replay: %s, %zu ticks\n", file_path, ticks);
+    printf("%-12s %7.0f ns per tick\n", "replay_step", update_ns/(ticks + 1));
+    printf("%-12s %7.0f ns per tick\n", "game_render", render_ns/(ticks + 1));
+    if (hash_trace != NULL) {
+        fclose(hash_trace);
+        printf("hash trace: %s\n", hash_trace_path);
+    }
+    if (!game_replay_verify()) {
+        fprintf(stderr, "ERROR: the replay diverged from the recording\n");
+        return 1;
+    }
+    printf("replay: OK\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t frames = 3600;
+    f32 dt = 1.0f/60.0f;
+    u32 width = 1600;
+    u32 height = 900;
+    bool random_input = false;
+    const char *log_path = NULL;
+    const char *trace_path = NULL;
+    const char *input_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    long seek = -1;
+    const char *hash_trace_path = NULL;
+    const char *golden_path = NULL;
+    bool golden_update = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--frames") == 0 && i + 1 < argc) {
+            frames = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--dt") == 0 && i + 1 < argc) {
+            dt = strtof(argv[++i], NULL);
+        } else if (strcmp(arg, "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%ux%u", &width, &height) != 2) usage(argv[0]);
+        } else if (strcmp(arg, "--random") == 0 && i + 1 < argc) {
+            random_input = true;
+            random_state = strtoull(argv[++i], NULL, 10);
+            // xorshift gets stuck on 0
+            if (random_state == 0) random_state = 0x9E3779B97F4A7C15ULL;
+        } else if (strcmp(arg, "--log") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (strcmp(arg, "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(arg, "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(arg, "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(arg, "--hash-trace") == 0 && i + 1 < argc) {
+            hash_trace_path = argv[++i];
+        } else if (strcmp(arg, "--seek") == 0 && i + 1 < argc) {
+            seek = strtol(argv[++i], NULL, 10);
+            if (seek < 0) usage(argv[0]);
+        } else if (strcmp(arg, "--golden") == 0 && i + 1 < argc) {
+            golden_path = argv[++i];
+        } else if (strcmp(arg, "--golden-update") == 0) {
+            golden_update = true;
+        } else if (strncmp(arg, "--", 2) != 0 && input_path == NULL) {
+            input_path = arg;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (frames == 0 || !(dt > 0.0f) || width == 0 || height == 0) usage(argv[0]);
+    if (golden_update && golden_path == NULL) usage(argv[0]);
+    if (golden_path != NULL) return golden_run(argv[0], golden_path, golden_update);
+    if (replay_path != NULL) return replay_run(replay_path, seek, hash_trace_path);
+    if (seek >= 0 || hash_trace_path != NULL) usage(argv[0]);
+    if (random_input && input_path != NULL) {
+        fprintf(stderr, "ERROR: --random and an input file are mutually exclusive\n");
+        return 1;
+    }
+
+    Scripted_Keys keys = {0};
+    if (input_path != NULL && !parse_input(input_path, &keys)) return 1;
+
+    if (log_path != NULL) {
+        command_log = fopen(log_path, "wb");
+        if (command_log == NULL) {
+            fprintf(stderr, "ERROR: could not open %s\n", log_path);
+            return 1;
+        }
+    }
+
+    double *update_ns = malloc(frames*sizeof(*update_ns));
+    double *render_ns = malloc(frames*sizeof(*render_ns));
+    assert(update_ns != NULL && render_ns != NULL && "Buy more RAM lol");
+
+    game_init(width, height);
+    if (record_path != NULL) game_record_begin();
+    memset(&calls, 0, sizeof(calls));
+
+    size_t keys_sent = 0;
+    size_t next_key = 0;
+    for (size_t frame = 0; frame < frames; ++frame) {
+        if (random_input) {
+            int key = random_key();
+            if (key != 0) {
+                game_input(frame*dt, key);
+                keys_sent += 1;
+            }
+        } else {
+            for (; next_key < keys.count && keys.items[next_key].frame <= frame; ++next_key) {
+                // NOTE: keys of frames that are already gone are delivered now
+                game_input(frame*dt, keys.items[next_key].key);
+                keys_sent += 1;
+            }
+        }
+
+        u32 frame_command[] = {CMD_FRAME, frame};
+        command_log_u32s(frame_command, sizeof(frame_command)/sizeof(frame_command[0]));
+
+        double t0 = now_ns();
+        game_update(dt);
+        double t1 = now_ns();
+        game_render();
+        double t2 = now_ns();
+
+        update_ns[frame] = t1 - t0;
+        render_ns[frame] = t2 - t1;
+
+        game_log_flush();
+    }
+
+    printf("headless: %zu frames at %ux%u, dt = %f, %zu keys\n", frames, width, height, dt, keys_sent);
+    print_stats("game_update", update_ns, frames);
+    print_stats("game_render", render_ns, frames);
+    printf("platform calls per frame:\n");
+    printf("    %-24s %.2f\n", "platform_fill_rect",   (double)calls.fill_rect/frames);
+    printf("    %-24s %.2f\n", "platform_fill_text",   (double)calls.fill_text/frames);
+    printf("    %-24s %.2f\n", "platform_log",         (double)calls.log/frames);
+    printf("    %-24s %.2f\n", "platform_stroke_rect", (double)calls.stroke_rect/frames);
+    printf("    %-24s %.2f\n", "platform_text_width",  (double)calls.text_width/frames);
+
+    if (command_log != NULL) {
+        printf("command log: %s (%ld bytes)\n", log_path, ftell(command_log));
+        fclose(command_log);
+    }
+
+    if (trace_path != NULL && !trace_dump(trace_path)) return 1;
+    if (record_path != NULL && !record_save(record_path)) return 1;
+
+    free(update_ns);
+    free(render_ns);
+    free(keys.items);
+
+    return 0;
+}
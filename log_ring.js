@@ -0,0 +1,81 @@
+'use strict';
+
+// Formatting of the binary log ring of the dev builds (see Log_Ring in game.h), shared by the hosts
+// that run the wasm module. The browser loads it with a <script> tag before wasm_main.js, Node
+// with require().
+
+function log_cstr(mem_buffer, ptr) {
+    const mem = new Uint8Array(mem_buffer);
+    let len = 0;
+    while (mem[ptr + len] != 0) len++;
+    return new TextDecoder().decode(new Uint8Array(mem_buffer, ptr, len));
+}
+
+// Layout of Log_Ring and Log_Entry from game.h on wasm32
+const LOG_RING_CAP = 256;
+const LOG_RING_ITEMS_OFFSET = 8;
+const LOG_ENTRY_SIZE = 48;
+const LOG_MAX_ARGS = 4;
+
+// printf of the LOGF() conversions the game uses, the arguments are the raw u64s of Log_Entry
+function log_format(buffer, fmt, args) {
+    let arg = 0;
+    return fmt.replace(/%([-+ 0#]*)(\d*)(?:\.(\d+))?(ll|l|hh|h)?([diucxXobfeEgGsp%])/g, (match, flags, width, precision, length, conversion) => {
+        if (conversion === '%') return '%';
+        const x = arg < args.length ? args[arg] : 0n;
+        arg += 1;
+        const bits = length === 'll' ? 64 : 32;
+        const f = () => new Float64Array(new BigUint64Array([x]).buffer)[0];
+        const p = precision === undefined ? 6 : parseInt(precision);
+        let s;
+        switch (conversion) {
+        case 'd': case 'i': s = BigInt.asIntN(bits, x).toString(); break;
+        case 'u':           s = BigInt.asUintN(bits, x).toString(); break;
+        case 'x':           s = BigInt.asUintN(bits, x).toString(16); break;
+        case 'X':           s = BigInt.asUintN(bits, x).toString(16).toUpperCase(); break;
+        case 'o':           s = BigInt.asUintN(bits, x).toString(8); break;
+        case 'b':           s = BigInt.asUintN(bits, x).toString(2); break;
+        case 'c':           s = String.fromCharCode(Number(BigInt.asUintN(8, x))); break;
+        case 'f':           s = f().toFixed(p); break;
+        case 'e': case 'E': s = f().toExponential(p); break;
+        case 'g': case 'G': s = f().toPrecision(p || 1); break;
+        case 's':           s = log_cstr(buffer, Number(x)); break;
+        case 'p':           s = '0x' + x.toString(16); break;
+        }
+        if (flags.includes('+') && /^[0-9]/.test(s) && 'dieEfgG'.includes(conversion)) s = '+' + s;
+        const w = parseInt(width) || 0;
+        if (s.length < w) {
+            if (flags.includes('-')) {
+                s = s.padEnd(w);
+            } else if (flags.includes('0')) {
+                const sign = /^[-+]/.test(s) ? s[0] : '';
+                s = sign + s.slice(sign.length).padStart(w - sign.length, '0');
+            } else {
+                s = s.padStart(w);
+            }
+        }
+        return s;
+    });
+}
+
+// Formats and prints the entries LOGF() put into the ring, only dev builds have one
+function log_flush(exports, print) {
+    const ring = exports.game_log_ring ? exports.game_log_ring() : 0;
+    if (ring == 0) return;
+    const buffer = exports.memory.buffer;
+    const view = new DataView(buffer);
+    const begin = view.getUint32(ring + 0, true);
+    const size = view.getUint32(ring + 4, true);
+    for (let i = 0; i < size; ++i) {
+        const entry = ring + LOG_RING_ITEMS_OFFSET + ((begin + i)%LOG_RING_CAP)*LOG_ENTRY_SIZE;
+        const fmt = log_cstr(buffer, view.getUint32(entry + 8, true));
+        const nargs = Math.min(view.getUint32(entry + 12, true), LOG_MAX_ARGS);
+        const args = [];
+        for (let j = 0; j < nargs; ++j) args.push(view.getBigUint64(entry + 16 + j*8, true));
+        print(log_format(buffer, fmt, args));
+    }
+    view.setUint32(ring + 0, 0, true);
+    view.setUint32(ring + 4, 0, true);
+}
+
+if (typeof module !== 'undefined') module.exports = { log_format, log_flush };
@@ -3,36 +3,176 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdbool.h>
 #include <raylib.h>
+#include <rlgl.h>
 
 #include "game.h"
 
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
 #define FACTOR 100
 #define WIDTH (16*FACTOR)
 #define HEIGHT (9*FACTOR)
 
 static Font font = {0};
+static Shader font_shader = {0};
+static bool font_sdf = false; // the default font is a plain bitmap, the shader only suits the SDF atlas
+
+// The font is rasterized once into a signed distance field atlas and every size is drawn from it
+// with the shader below, so text stays sharp at whatever size the game asks for.
+#define FONT_SDF_BASE_SIZE 48
+#define FONT_SDF_GLYPH_COUNT 95 // printable ASCII, what LoadFontData() picks with no codepoints
+#define FONT_SDF_PADDING 0
+
+static const char *font_sdf_fs =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 colDiffuse;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float distance = texture(texture0, fragTexCoord).a - 0.5;\n"
+    "    float width = length(vec2(dFdx(distance), dFdy(distance)));\n"
+    "    float alpha = smoothstep(-width, width, distance);\n"
+    "    finalColor = vec4(fragColor.rgb, fragColor.a*alpha)*colDiffuse;\n"
+    "}\n";
+
+static Font font_load_sdf(const char *file_path)
+{
+    Font result = {0};
+    int size = 0;
+    unsigned char *data = LoadFileData(file_path, &size);
+    if (data == NULL) return GetFontDefault();
+
+    result.baseSize = FONT_SDF_BASE_SIZE;
+    result.glyphCount = FONT_SDF_GLYPH_COUNT;
+    result.glyphs = LoadFontData(data, size, result.baseSize, NULL, 0, FONT_SDF);
+    UnloadFileData(data);
+    if (result.glyphs == NULL) return GetFontDefault();
+
+    Image atlas = GenImageFontAtlas(result.glyphs, &result.recs, result.glyphCount, result.baseSize, FONT_SDF_PADDING, 1);
+    result.texture = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
+
+    // NOTE: no mipmaps, the shader takes care of minification
+    SetTextureFilter(result.texture, TEXTURE_FILTER_BILINEAR);
+    font_sdf = true;
+    return result;
+}
+
+// Consecutive filled rects are streamed as a single run of RL_QUADS with the default (white)
+// texture instead of going through DrawRectangle() one by one. The render batch has room for
+// everything a frame of the WIDTHxHEIGHT window draws, so it never fills up in the middle of one:
+// 4 rects per cell of a snake filling the 16x9 board, a rect per background cell on the screen
+// plus a cell of margin around it, the outlines of the dev build (8 line vertices, the room of 2
+// quads, per cell and for the board), and the egg, the text glyphs and the dev HUD (its 120 bars
+// and two lines of text). It is still drawn early whenever the text switches to the SDF shader,
+// and a bigger window fills it up.
+// Several buffers rotate so a flush does not wait for the GPU to finish with the previous one.
+#define RECT_BATCH_SNAKE_CELLS (16*9)
+#define RECT_BATCH_BACKGROUND_CELLS ((WIDTH/FACTOR + 3)*(HEIGHT/FACTOR + 3))
+#define RECT_BATCH_DEV_OUTLINES ((RECT_BATCH_SNAKE_CELLS + 1)*2)
+#define RECT_BATCH_OVERLAY_QUADS 384
+#define RECT_BATCH_QUADS (RECT_BATCH_SNAKE_CELLS*4 + RECT_BATCH_BACKGROUND_CELLS + RECT_BATCH_DEV_OUTLINES + RECT_BATCH_OVERLAY_QUADS)
+#define RECT_BATCH_BUFFERS 4
+static rlRenderBatch rect_batch = {0};
+static bool rect_batching = true;
+static bool rect_stream_open = false;
+static size_t rect_count = 0; // for --bench
+
+static void rect_stream_close(void)
+{
+    if (!rect_stream_open) return;
+    rlEnd();
+    rlSetTexture(0);
+    rect_stream_open = false;
+}
 
 void platform_fill_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
 {
-    DrawRectangle(x, y, w, h, *(Color*)&color);
+    rect_count += 1;
+    Color c = *(Color*)&color;
+    if (!rect_batching) {
+        DrawRectangle(x, y, w, h, c);
+        return;
+    }
+    if (!rect_stream_open) {
+        rlSetTexture(rlGetTextureIdDefault());
+        rlBegin(RL_QUADS);
+        rect_stream_open = true;
+    }
+    rlColor4ub(c.r, c.g, c.b, c.a);
+    rlVertex2f(x,     y);
+    rlVertex2f(x,     y + h);
+    rlVertex2f(x + w, y + h);
+    rlVertex2f(x + w, y);
 }
 
 void platform_stroke_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
 {
+    rect_stream_close();
     DrawRectangleLines(x, y, w, h, *(Color*)&color);
 }
 
+// Measured sizes of the texts the game has asked about, per font size. The game only ever
+// shows a handful of distinct strings, but the score keeps changing, so each per-size table is
+// simply dropped once it gets too big.
+#define TEXT_SIZE_CACHE_CAP 256
+
+typedef struct {
+    char *key;
+    Vector2 value;
+} Text_Size;
+
+typedef struct {
+    u32 key;
+    Text_Size *value;
+} Text_Size_Cache;
+
+static Text_Size_Cache *text_sizes = NULL;
+
+static Vector2 measure_text(const char *text, u32 size)
+{
+    ptrdiff_t i = hmgeti(text_sizes, size);
+    if (i < 0) {
+        Text_Size *texts = NULL;
+        sh_new_strdup(texts);
+        hmput(text_sizes, size, texts);
+        i = hmgeti(text_sizes, size);
+    }
+
+    Text_Size *texts = text_sizes[i].value;
+    ptrdiff_t j = shgeti(texts, text);
+    if (j < 0) {
+        if (shlen(texts) >= TEXT_SIZE_CACHE_CAP) {
+            shfree(texts);
+            sh_new_strdup(texts);
+        }
+        // NOTE: must match the spacing platform_fill_text() draws with
+        shput(texts, text, MeasureTextEx(font, text, size, 0));
+        text_sizes[i].value = texts;
+        j = shgeti(texts, text);
+    }
+    return texts[j].value;
+}
+
 u32 platform_text_width(const char *text, u32 size)
 {
-    return MeasureText(text, size);
+    return measure_text(text, size).x;
 }
 
 void platform_fill_text(i32 x, i32 y, const char *text, u32 fontSize, u32 color)
 {
-    Vector2 size = MeasureTextEx(font, text, fontSize, 0);
+    rect_stream_close();
+    Vector2 size = measure_text(text, fontSize);
     Vector2 position = {.x = x, .y = y - size.y};
+    if (font_sdf) BeginShaderMode(font_shader);
     DrawTextEx(font, text, position, fontSize, 0.0, *(Color*)&color);
+    if (font_sdf) EndShaderMode();
 }
 
 void platform_panic(const char *file_path, i32 line, const char *message)
@@ -46,30 +186,124 @@ void platform_log(const char *message)
     TraceLog(LOG_INFO, "%s", message);
 }
 
-int main(void)
+u64 platform_now_ns(void)
 {
+    return GetTime()*1e9;
+}
+
+#define FRAME_MAX_DT 0.25f // see game_update() in game.h
+
+static void frame(f32 dt)
+{
+    BeginDrawing();
+    game_update(dt);
+    game_render();
+    rect_stream_close();
+    EndDrawing();
+    game_log_flush();
+}
+
+// Times the frames of both rect paths at a few snake lengths, restored from serpentine snapshots
+static const u32 bench_lengths[] = {3, 32, 64, 100, 143};
+#define BENCH_FRAMES 600
+
+static void bench(void)
+{
+    for (size_t stage = 0; stage < sizeof(bench_lengths)/sizeof(bench_lengths[0]); ++stage) {
+        u32 len = bench_lengths[stage];
+        game_snapshot_serpentine(game_snapshot_buffer(), len);
+        game_snapshot_restore(game_snapshot_buffer());
+
+        double ms[2] = {0};
+        size_t rects = 0;
+        for (int path = 0; path < 2; ++path) {
+            rect_batching = path == 1;
+            rect_count = 0;
+            double start = GetTime();
+            for (int i = 0; i < BENCH_FRAMES; ++i) frame(0.0f);
+            ms[path] = (GetTime() - start)*1000.0/BENCH_FRAMES;
+            rects = rect_count/BENCH_FRAMES;
+        }
+        TraceLog(LOG_INFO, "bench: snake of %3u, %4zu rects/frame: DrawRectangle %.3fms/frame, rlgl quads %.3fms/frame (%.2fx)",
+                 len, rects, ms[0], ms[1], ms[0]/ms[1]);
+    }
+}
+
+// Writes the recording started with --record, see game_record_begin() in game.h
+static void record_save(const char *file_path)
+{
+    u32 size = game_record_end();
+    if (size == 0) {
+        TraceLog(LOG_WARNING, "the recording does not fit into %u bytes", REPLAY_CAP);
+        return;
+    }
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        TraceLog(LOG_WARNING, "could not open %s", file_path);
+        return;
+    }
+    fwrite(game_replay_buffer(), 1, size, f);
+    fclose(f);
+    TraceLog(LOG_INFO, "recording: %s (%u bytes)", file_path, size);
+}
+
+int main(int argc, char **argv)
+{
+    bool bench_mode = false;
+    const char *record_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--immediate") == 0) {
+            rect_batching = false;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench_mode = true;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--immediate] [--bench] [--record FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
     InitWindow(WIDTH, HEIGHT, "Snake");
     game_init(WIDTH, HEIGHT);
+    if (record_path != NULL) game_record_begin();
+
+    rect_batch = rlLoadRenderBatch(RECT_BATCH_BUFFERS, RECT_BATCH_QUADS);
+    rlSetRenderBatchActive(&rect_batch);
 
-    font = LoadFontEx("fonts/AnekLatin-Light.ttf", 48, NULL, 0);
-    GenTextureMipmaps(&font.texture);
-    SetTextureFilter(font.texture, TEXTURE_FILTER_BILINEAR);
+    font = font_load_sdf("fonts/AnekLatin-Light.ttf");
+    font_shader = LoadShaderFromMemory(NULL, font_sdf_fs);
 
-    while (!WindowShouldClose()) {
-        const char *keys = "ADWS RZXC";
-        size_t n = strlen(keys);
-        for (size_t i = 0; i < n; ++i) {
-            if (IsKeyPressed(keys[i])) {
-                game_keydown(tolower(keys[i]));
+    if (bench_mode) {
+        bench();
+    } else {
+        while (!WindowShouldClose()) {
+            const char *keys = "ADWS RZXCH";
+            size_t n = strlen(keys);
+            for (size_t i = 0; i < n; ++i) {
+                if (IsKeyPressed(keys[i])) {
+                    game_keydown(tolower(keys[i]));
+                }
             }
+
+            f32 dt = GetFrameTime();
+            if (dt > FRAME_MAX_DT) dt = FRAME_MAX_DT;
+            frame(dt);
         }
+    }
+
+    if (record_path != NULL) record_save(record_path);
 
-        BeginDrawing();
-        game_update(GetFrameTime());
-        game_render();
-        EndDrawing();
+    for (ptrdiff_t i = 0; i < hmlen(text_sizes); ++i) {
+        shfree(text_sizes[i].value);
     }
+    hmfree(text_sizes);
+
+    UnloadShader(font_shader);
+    UnloadFont(font);
 
+    rlSetRenderBatchActive(NULL);
+    rlUnloadRenderBatch(rect_batch);
     CloseWindow();
 
     return 0;
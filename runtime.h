@@ -0,0 +1,85 @@
+#ifndef RUNTIME_H_
+#define RUNTIME_H_
+
+// Minimal freestanding runtime shared by every build of the game.
+//
+// Define RUNTIME_IMPLEMENTATION in exactly one translation unit before including this file.
+// In the wasm build compiled with -mbulk-memory the functions are single memory.fill/memory.copy
+// instructions, everywhere else they move a machine word at a time.
+
+#include <stddef.h>
+
+void *rt_memset(void *dest, int c, size_t n);
+void *rt_memcpy(void *dest, const void *src, size_t n);
+
+#endif // RUNTIME_H_
+
+#ifdef RUNTIME_IMPLEMENTATION
+
+#if defined(__wasm__) && defined(__wasm_bulk_memory__)
+
+void *rt_memset(void *dest, int c, size_t n)
+{
+    return __builtin_memset(dest, c, n);
+}
+
+void *rt_memcpy(void *dest, const void *src, size_t n)
+{
+    return __builtin_memcpy(dest, src, n);
+}
+
+#else
+
+typedef size_t rt_word __attribute__((__may_alias__));
+typedef size_t rt_unaligned_word __attribute__((__may_alias__, __aligned__(1)));
+#define RT_WORD_MASK (sizeof(rt_word) - 1)
+
+void *rt_memset(void *dest, int c, size_t n)
+{
+    unsigned char *d = dest;
+    while (n > 0 && ((size_t)d&RT_WORD_MASK) != 0) {
+        *d++ = c;
+        n -= 1;
+    }
+    rt_word word = ((rt_word)-1/0xFF)*(unsigned char)c;
+    for (; n >= sizeof(rt_word); n -= sizeof(rt_word), d += sizeof(rt_word)) {
+        *(rt_word*)d = word;
+    }
+    while (n-- > 0) *d++ = c;
+    return dest;
+}
+
+void *rt_memcpy(void *dest, const void *src, size_t n)
+{
+    unsigned char *d = dest;
+    const unsigned char *s = src;
+    while (n > 0 && ((size_t)d&RT_WORD_MASK) != 0) {
+        *d++ = *s++;
+        n -= 1;
+    }
+    // NOTE: the source is not necessarily aligned along with the destination (a Cell array inside
+    // of a struct is only 4-aligned), read it a word at a time anyway
+    for (; n >= sizeof(rt_word); n -= sizeof(rt_word), d += sizeof(rt_word), s += sizeof(rt_word)) {
+        *(rt_word*)d = *(const rt_unaligned_word*)s;
+    }
+    while (n-- > 0) *d++ = *s++;
+    return dest;
+}
+
+#endif
+
+#ifdef __wasm__
+// NOTE: there is no libc in the wasm build, but the compiler still emits calls to these for
+// zeroing and copying structs
+void *memset(void *dest, int c, size_t n)
+{
+    return rt_memset(dest, c, n);
+}
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+    return rt_memcpy(dest, src, n);
+}
+#endif
+
+#endif // RUNTIME_IMPLEMENTATION
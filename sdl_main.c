@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 
@@ -36,76 +38,154 @@ void *scp(void *ptr)
 static SDL_Renderer *renderer = NULL;
 static SDL_Window *window = NULL;
 
+// Printable ASCII is drawn from a per-size glyph atlas, so changing text (like the score) costs no
+// rasterization and no texture uploads. The game draws nothing else, any other text is rendered
+// into a temporary texture every time.
+#define GLYPH_FIRST ' '
+#define GLYPH_LAST  '~'
+#define GLYPH_COUNT (GLYPH_LAST - GLYPH_FIRST + 1)
+#define GLYPH_ATLAS_WIDTH 1024
+
+typedef struct {
+    SDL_Rect src; // in the atlas, the full line height of the font
+    int advance;
+} Glyph;
+
 typedef struct {
-    char *key; // text
-    SDL_Surface *surface;
     SDL_Texture *texture;
-} Font_Text_Surface;
+    int width;
+    int height;
+    Glyph glyphs[GLYPH_COUNT];
+} Glyph_Atlas;
 
 typedef struct {
     int key; // ptsize
     TTF_Font *font;
-    Font_Text_Surface *texts;
+    Glyph_Atlas atlas;
 } Font_Cache;
 
 static Font_Cache *font_cache = NULL;
 
-ptrdiff_t font_cache_get_size(int size)
+void glyph_atlas_build(Glyph_Atlas *atlas, TTF_Font *font)
 {
-    ptrdiff_t font_index = hmgeti(font_cache, (int) size);
-    if (font_index < 0) {
-        Font_Cache item = {0};
-        item.key = size;
-        item.font = scp(TTF_OpenFont(ANEK_LATIN_FILE_PATH, size));
-        hmputs(font_cache, item);
-        font_index = hmgeti(font_cache, (int) size);
-        assert(font_index >= 0);
-        printf("[LOG] new font size %d\n", (int) size);
+    SDL_Color fg = { .r = 0xFF, .g = 0xFF, .b = 0xFF, .a = 0xFF, };
+    SDL_Surface *surfaces[GLYPH_COUNT] = {0};
+
+    // Shelf packing, every glyph surface is as tall as the line so there is one shelf per row
+    int x = 0;
+    int y = 0;
+    int row_height = 0;
+    for (int i = 0; i < GLYPH_COUNT; ++i) {
+        Glyph *glyph = &atlas->glyphs[i];
+        surfaces[i] = scp(TTF_RenderGlyph_Blended(font, GLYPH_FIRST + i, fg));
+        scc(TTF_GlyphMetrics(font, GLYPH_FIRST + i, NULL, NULL, NULL, NULL, &glyph->advance));
+        if (x + surfaces[i]->w > GLYPH_ATLAS_WIDTH) {
+            x = 0;
+            y += row_height;
+            row_height = 0;
+        }
+        glyph->src = (SDL_Rect) { .x = x, .y = y, .w = surfaces[i]->w, .h = surfaces[i]->h, };
+        x += surfaces[i]->w;
+        if (row_height < surfaces[i]->h) row_height = surfaces[i]->h;
     }
-    return font_index;
+    atlas->width = GLYPH_ATLAS_WIDTH;
+    atlas->height = y + row_height;
+
+    SDL_Surface *pixels = scp(SDL_CreateRGBSurfaceWithFormat(0, atlas->width, atlas->height, 32, SDL_PIXELFORMAT_ARGB8888));
+    for (int i = 0; i < GLYPH_COUNT; ++i) {
+        scc(SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE));
+        scc(SDL_BlitSurface(surfaces[i], NULL, pixels, &atlas->glyphs[i].src));
+        SDL_FreeSurface(surfaces[i]);
+    }
+    atlas->texture = scp(SDL_CreateTextureFromSurface(renderer, pixels));
+    scc(SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND));
+    SDL_FreeSurface(pixels);
 }
 
-ptrdiff_t font_cache_get_text(ptrdiff_t font_index, const char *text)
+bool glyph_atlas_covers(const char *text)
 {
-    ptrdiff_t text_index = shgeti(font_cache[font_index].texts, text);
-    if (text_index < 0) {
-        SDL_Color fg = { .r = 0xFF, .g = 0xFF, .b = 0xFF, .a = 0xFF, };
-        Font_Text_Surface item = {0};
-        item.key = (char*) text;
-        item.surface = scp(TTF_RenderText_Blended(font_cache[font_index].font, text, fg));
-        item.texture = SDL_CreateTextureFromSurface(renderer, item.surface);
-        scc(SDL_SetTextureBlendMode(item.texture, SDL_BLENDMODE_BLEND));
-        shputs(font_cache[font_index].texts, item);
-        text_index = shgeti(font_cache[font_index].texts, text);
-        assert(text_index >= 0);
-        printf("[LOG] new text \"%s\"\n", text);
+    for (; *text; ++text) {
+        if (*text < GLYPH_FIRST || *text > GLYPH_LAST) return false;
     }
-    return text_index;
+    return true;
 }
 
-u32 platform_text_width(const char *text, u32 size)
+int glyph_atlas_kerning(TTF_Font *font, const char *text)
 {
-    ptrdiff_t font_index = font_cache_get_size(size);
-    ptrdiff_t text_index = font_cache_get_text(font_index, text);
-    SDL_Surface *surface = font_cache[font_index].texts[text_index].surface;
-    return surface->w;
+    return text[1] != '\0' ? TTF_GetFontKerningSizeGlyphs(font, text[0], text[1]) : 0;
 }
 
-void platform_fill_text(i32 x, i32 y, const char *text, u32 size, u32 c)
+static SDL_Vertex *glyph_vertices = NULL;
+static int *glyph_indices = NULL;
+
+// (x, y) is the bottom left corner of the line
+void glyph_atlas_fill_text(Glyph_Atlas *atlas, TTF_Font *font, int x, int y, const char *text)
 {
-    ptrdiff_t font_index = font_cache_get_size(size);
-    ptrdiff_t text_index = font_cache_get_text(font_index, text);
-    SDL_Surface *surface = font_cache[font_index].texts[text_index].surface;
-    SDL_Texture *texture = font_cache[font_index].texts[text_index].texture;
+    size_t n = strlen(text);
+    if (n == 0) return;
+    arrsetlen(glyph_vertices, 4*n);
+    arrsetlen(glyph_indices, 6*n);
+
+    SDL_Color white = { .r = 0xFF, .g = 0xFF, .b = 0xFF, .a = 0xFF, };
+    for (size_t i = 0; i < n; ++i) {
+        Glyph *glyph = &atlas->glyphs[text[i] - GLYPH_FIRST];
+        float x0 = x;
+        float y0 = y - glyph->src.h;
+        float x1 = x + glyph->src.w;
+        float y1 = y;
+        float u0 = (float) glyph->src.x/atlas->width;
+        float v0 = (float) glyph->src.y/atlas->height;
+        float u1 = (float) (glyph->src.x + glyph->src.w)/atlas->width;
+        float v1 = (float) (glyph->src.y + glyph->src.h)/atlas->height;
+
+        SDL_Vertex *v = &glyph_vertices[4*i];
+        v[0] = (SDL_Vertex) { .position = {x0, y0}, .color = white, .tex_coord = {u0, v0} };
+        v[1] = (SDL_Vertex) { .position = {x1, y0}, .color = white, .tex_coord = {u1, v0} };
+        v[2] = (SDL_Vertex) { .position = {x1, y1}, .color = white, .tex_coord = {u1, v1} };
+        v[3] = (SDL_Vertex) { .position = {x0, y1}, .color = white, .tex_coord = {u0, v1} };
+
+        int *index = &glyph_indices[6*i];
+        int base = 4*i;
+        index[0] = base + 0;
+        index[1] = base + 1;
+        index[2] = base + 2;
+        index[3] = base + 2;
+        index[4] = base + 3;
+        index[5] = base + 0;
+
+        x += glyph->advance + glyph_atlas_kerning(font, &text[i]);
+    }
+    scc(SDL_RenderGeometry(renderer, atlas->texture,
+                           glyph_vertices, 4*n,
+                           glyph_indices, 6*n));
+}
 
-    int descent = TTF_FontDescent(font_cache[font_index].font);
+// NOTE: TTF_OpenFont() touches the FreeType library shared by all the fonts. Once opened, each
+// TTF_Font is only ever used by the thread that opened it.
+static SDL_mutex *ttf_mutex = NULL;
 
-    SDL_Rect src = { .w = surface->w, .h = surface->h, };
-    SDL_Rect dst = { .x = x, .y = y - surface->h - descent, .w = surface->w, .h = surface->h, };
-    scc(SDL_RenderCopy(renderer, texture, &src, &dst));
+TTF_Font *ttf_open_font(int size)
+{
+    scc(SDL_LockMutex(ttf_mutex));
+    TTF_Font *font = scp(TTF_OpenFont(ANEK_LATIN_FILE_PATH, size));
+    scc(SDL_UnlockMutex(ttf_mutex));
+    return font;
+}
 
-    // TODO: custom color for SDL2 platform_fill_text
-    (void) c;
+ptrdiff_t font_cache_get_size(int size)
+{
+    ptrdiff_t font_index = hmgeti(font_cache, (int) size);
+    if (font_index < 0) {
+        Font_Cache item = {0};
+        item.key = size;
+        item.font = ttf_open_font(size);
+        hmputs(font_cache, item);
+        font_index = hmgeti(font_cache, (int) size);
+        assert(font_index >= 0);
+        glyph_atlas_build(&font_cache[font_index].atlas, font_cache[font_index].font);
+        printf("[LOG] new font size %d\n", (int) size);
+    }
+    return font_index;
 }
 
 SDL_Color unpack_color(uint32_t color)
@@ -118,32 +198,247 @@ SDL_Color unpack_color(uint32_t color)
     };
 }
 
-void platform_fill_rect(int x, int y, int w, int h, uint32_t c)
+// Filled rects of a frame are collected into a single SDL_RenderGeometry() call with per-vertex
+// colors. Triangles are drawn in submission order, so overlapping rects and alpha blend exactly as
+// they did one SDL_RenderFillRect() at a time. The batch is flushed before anything that is not a
+// filled rect is drawn and at the end of the frame.
+static SDL_Vertex *rect_batch_vertices = NULL;
+static int *rect_batch_indices = NULL;
+static size_t rect_batch_count = 0;
+
+void rect_batch_push(int x, int y, int w, int h, SDL_Color color)
 {
-    assert(renderer != NULL);
-    SDL_Rect rect = {.x = x, .y = y, .w = w, .h = h,};
+    size_t i = rect_batch_count++;
+    arrsetlen(rect_batch_vertices, 4*rect_batch_count);
+    arrsetlen(rect_batch_indices, 6*rect_batch_count);
+
+    SDL_Vertex *v = &rect_batch_vertices[4*i];
+    v[0] = (SDL_Vertex) { .position = {x,     y},     .color = color };
+    v[1] = (SDL_Vertex) { .position = {x + w, y},     .color = color };
+    v[2] = (SDL_Vertex) { .position = {x + w, y + h}, .color = color };
+    v[3] = (SDL_Vertex) { .position = {x,     y + h}, .color = color };
+
+    int *index = &rect_batch_indices[6*i];
+    int base = 4*i;
+    index[0] = base + 0;
+    index[1] = base + 1;
+    index[2] = base + 2;
+    index[3] = base + 2;
+    index[4] = base + 3;
+    index[5] = base + 0;
+}
+
+void rect_batch_flush(void)
+{
+    if (rect_batch_count == 0) return;
+    scc(SDL_RenderGeometry(renderer, NULL,
+                           rect_batch_vertices, 4*rect_batch_count,
+                           rect_batch_indices, 6*rect_batch_count));
+    rect_batch_count = 0;
+}
+
+void render_fill_text(i32 x, i32 y, const char *text, u32 size, u32 c)
+{
+    rect_batch_flush();
+
+    ptrdiff_t font_index = font_cache_get_size(size);
+    TTF_Font *font = font_cache[font_index].font;
+    int descent = TTF_FontDescent(font);
     SDL_Color color = unpack_color(c);
-    scc(SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a));
-    scc(SDL_RenderFillRect(renderer, &rect));
+
+    if (glyph_atlas_covers(text)) {
+        Glyph_Atlas *atlas = &font_cache[font_index].atlas;
+        scc(SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b));
+        scc(SDL_SetTextureAlphaMod(atlas->texture, color.a));
+        glyph_atlas_fill_text(atlas, font, x, y - descent, text);
+        return;
+    }
+
+    SDL_Color fg = { .r = 0xFF, .g = 0xFF, .b = 0xFF, .a = 0xFF, };
+    SDL_Surface *surface = scp(TTF_RenderText_Blended(font, text, fg));
+    SDL_Texture *texture = scp(SDL_CreateTextureFromSurface(renderer, surface));
+    SDL_Rect dst = { .x = x, .y = y - surface->h - descent, .w = surface->w, .h = surface->h, };
+    SDL_FreeSurface(surface);
+    scc(SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND));
+    scc(SDL_SetTextureColorMod(texture, color.r, color.g, color.b));
+    scc(SDL_SetTextureAlphaMod(texture, color.a));
+    scc(SDL_RenderCopy(renderer, texture, NULL, &dst));
+    SDL_DestroyTexture(texture);
 }
 
-void platform_stroke_rect(int x, int y, int w, int h, uint32_t c)
+void render_stroke_rect(int x, int y, int w, int h, uint32_t c)
 {
     assert(renderer != NULL);
+    rect_batch_flush();
     SDL_Rect rect = {.x = x, .y = y, .w = w, .h = h,};
     SDL_Color color = unpack_color(c);
     scc(SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a));
     scc(SDL_RenderDrawRect(renderer, &rect));
 }
 
-void platform_stroke_line(i32 x1, i32 y1, i32 x2, i32 y2, u32 c)
+void render_stroke_line(i32 x1, i32 y1, i32 x2, i32 y2, u32 c)
 {
     assert(renderer != NULL);
+    rect_batch_flush();
     SDL_Color color = unpack_color(c);
     scc(SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a));
     scc(SDL_RenderDrawLine(renderer, x1, y1, x2, y2));
 }
 
+// The simulation thread runs game_update() and game_render(), the main thread polls the events
+// and draws. game_render() does not draw anything itself: the platform_* functions below record
+// the frame into a Snapshot which is handed over to the main thread through a lock-free triple
+// buffer. The events travel the other way through a single-producer/single-consumer queue.
+
+typedef enum {
+    COMMAND_FILL_RECT,
+    COMMAND_STROKE_RECT,
+    COMMAND_STROKE_LINE,
+    COMMAND_FILL_TEXT,
+} Command_Kind;
+
+typedef struct {
+    Command_Kind kind;
+    i32 x, y, w, h; // COMMAND_STROKE_LINE: x1, y1, x2, y2. COMMAND_FILL_TEXT: h is the font size
+    u32 color;
+    size_t text; // COMMAND_FILL_TEXT: offset into Snapshot.text
+} Command;
+
+// NOTE: stb_ds arrays that are reused from frame to frame. Only the thread owning the slot of the
+// triple buffer may touch them.
+typedef struct {
+    Command *commands;
+    char *text;
+    Latency_Sample *latencies; // turns shown for the first time, times are on the host input clock
+} Snapshot;
+
+#define SNAPSHOT_FRESH 4
+
+typedef struct {
+    Snapshot slots[3];
+    atomic_uint middle; // index of the slot in the middle | SNAPSHOT_FRESH if it was not consumed yet
+    unsigned back;      // owned by the simulation thread
+    unsigned front;     // owned by the main thread
+} Triple_Buffer;
+
+static Triple_Buffer snapshots = { .middle = 0, .back = 1, .front = 2 };
+
+Snapshot *snapshot_back(void)
+{
+    return &snapshots.slots[snapshots.back];
+}
+
+// Returns true if the slot that comes back to the simulation thread was never consumed
+bool snapshot_publish(void)
+{
+    unsigned prev = atomic_exchange_explicit(&snapshots.middle, snapshots.back | SNAPSHOT_FRESH, memory_order_acq_rel);
+    snapshots.back = prev & ~SNAPSHOT_FRESH;
+    return prev & SNAPSHOT_FRESH;
+}
+
+// Returns the latest published snapshot, or the previous one again if nothing new was published
+Snapshot *snapshot_latest(void)
+{
+    if (atomic_load_explicit(&snapshots.middle, memory_order_relaxed) & SNAPSHOT_FRESH) {
+        unsigned prev = atomic_exchange_explicit(&snapshots.middle, snapshots.front, memory_order_acq_rel);
+        snapshots.front = prev & ~SNAPSHOT_FRESH;
+    }
+    return &snapshots.slots[snapshots.front];
+}
+
+void record_command(Command command)
+{
+    arrput(snapshot_back()->commands, command);
+}
+
+void platform_fill_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
+{
+    record_command((Command) { .kind = COMMAND_FILL_RECT, .x = x, .y = y, .w = w, .h = h, .color = color });
+}
+
+void platform_stroke_rect(i32 x, i32 y, i32 w, i32 h, u32 color)
+{
+    record_command((Command) { .kind = COMMAND_STROKE_RECT, .x = x, .y = y, .w = w, .h = h, .color = color });
+}
+
+void platform_stroke_line(i32 x1, i32 y1, i32 x2, i32 y2, u32 color)
+{
+    record_command((Command) { .kind = COMMAND_STROKE_LINE, .x = x1, .y = y1, .w = x2, .h = y2, .color = color });
+}
+
+void platform_fill_text(i32 x, i32 y, const char *text, u32 size, u32 color)
+{
+    Snapshot *snapshot = snapshot_back();
+    size_t offset = arrlen(snapshot->text);
+    size_t n = strlen(text) + 1;
+    memcpy(arraddnptr(snapshot->text, n), text, n);
+    record_command((Command) { .kind = COMMAND_FILL_TEXT, .x = x, .y = y, .h = size, .color = color, .text = offset });
+}
+
+void snapshot_render(Snapshot *snapshot)
+{
+    for (ptrdiff_t i = 0; i < arrlen(snapshot->commands); ++i) {
+        Command *command = &snapshot->commands[i];
+        switch (command->kind) {
+        case COMMAND_FILL_RECT:
+            rect_batch_push(command->x, command->y, command->w, command->h, unpack_color(command->color));
+            break;
+        case COMMAND_STROKE_RECT:
+            render_stroke_rect(command->x, command->y, command->w, command->h, command->color);
+            break;
+        case COMMAND_STROKE_LINE:
+            render_stroke_line(command->x, command->y, command->w, command->h, command->color);
+            break;
+        case COMMAND_FILL_TEXT:
+            render_fill_text(command->x, command->y, &snapshot->text[command->text], command->h, command->color);
+            break;
+        }
+    }
+    rect_batch_flush();
+}
+
+// The simulation thread measures text with fonts of its own, see ttf_mutex
+typedef struct {
+    int key; // ptsize
+    TTF_Font *font;
+    int advances[GLYPH_COUNT];
+} Font_Metrics;
+
+static Font_Metrics *font_metrics = NULL;
+
+ptrdiff_t font_metrics_get_size(int size)
+{
+    ptrdiff_t index = hmgeti(font_metrics, size);
+    if (index < 0) {
+        Font_Metrics item = {0};
+        item.key = size;
+        item.font = ttf_open_font(size);
+        for (int i = 0; i < GLYPH_COUNT; ++i) {
+            scc(TTF_GlyphMetrics(item.font, GLYPH_FIRST + i, NULL, NULL, NULL, NULL, &item.advances[i]));
+        }
+        hmputs(font_metrics, item);
+        index = hmgeti(font_metrics, size);
+        assert(index >= 0);
+    }
+    return index;
+}
+
+u32 platform_text_width(const char *text, u32 size)
+{
+    Font_Metrics *metrics = &font_metrics[font_metrics_get_size(size)];
+    if (glyph_atlas_covers(text)) {
+        // NOTE: must match the pen advance of glyph_atlas_fill_text()
+        int width = 0;
+        for (; *text; ++text) {
+            width += metrics->advances[*text - GLYPH_FIRST] + glyph_atlas_kerning(metrics->font, text);
+        }
+        return width;
+    }
+    int width = 0;
+    scc(TTF_SizeText(metrics->font, text, &width, NULL));
+    return width;
+}
+
 void platform_panic(const char *file_path, int line, const char *message)
 {
     fprintf(stderr, "%s:%d: GAME ASSERTION FAILED: %s\n", file_path, line, message);
@@ -155,12 +450,235 @@ void platform_log(const char *message)
     printf("[LOG] %s\n", message);
 }
 
-int main()
+u64 platform_now_ns(void)
 {
+    u64 counter = SDL_GetPerformanceCounter();
+    u64 freq = SDL_GetPerformanceFrequency();
+    // NOTE: split so counter*1e9 does not overflow
+    return counter/freq*1000000000 + counter%freq*1000000000/freq;
+}
+
+typedef enum {
+    HOST_EVENT_KEY,
+    HOST_EVENT_RESIZE,
+} Host_Event_Kind;
+
+typedef struct {
+    Host_Event_Kind kind;
+    double time; // HOST_EVENT_KEY: seconds since the origin of the input clock
+    int key;
+    int width, height;
+} Host_Event;
+
+#define HOST_EVENT_QUEUE_CAP 256 // must be a power of two
+
+typedef struct {
+    Host_Event items[HOST_EVENT_QUEUE_CAP];
+    atomic_size_t head; // written by the consumer (simulation thread)
+    atomic_size_t tail; // written by the producer (main thread)
+} Host_Event_Queue;
+
+static Host_Event_Queue host_events = {0};
+
+bool host_event_push(Host_Event event)
+{
+    size_t tail = atomic_load_explicit(&host_events.tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&host_events.head, memory_order_acquire);
+    if (tail - head >= HOST_EVENT_QUEUE_CAP) return false;
+    host_events.items[tail&(HOST_EVENT_QUEUE_CAP - 1)] = event;
+    atomic_store_explicit(&host_events.tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool host_event_pop(Host_Event *event)
+{
+    size_t head = atomic_load_explicit(&host_events.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&host_events.tail, memory_order_acquire);
+    if (head == tail) return false;
+    *event = host_events.items[head&(HOST_EVENT_QUEUE_CAP - 1)];
+    atomic_store_explicit(&host_events.head, head + 1, memory_order_release);
+    return true;
+}
+
+#define TARGET_FPS 60
+// NOTE: SDL_Delay() may oversleep by a couple of milliseconds, the rest of the wait is spent spinning
+#define FRAME_SPIN_MARGIN_MS 2
+#define FRAME_MAX_DT 0.25 // see game_update() in game.h
+
+void frame_wait_until(Uint64 deadline)
+{
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    for (;;) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now >= deadline) break;
+        Uint64 remaining_ms = (deadline - now)*1000/freq;
+        if (remaining_ms > FRAME_SPIN_MARGIN_MS) SDL_Delay(remaining_ms - FRAME_SPIN_MARGIN_MS);
+    }
+}
+
+#define FRAME_STATS_WINDOW 600
+
+typedef struct {
+    double items[FRAME_STATS_WINDOW];
+    size_t count;
+} Frame_Stats;
+
+static Frame_Stats frame_stats = {0};
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+void frame_stats_push(double ms)
+{
+    frame_stats.items[frame_stats.count++] = ms;
+    if (frame_stats.count < FRAME_STATS_WINDOW) return;
+
+    double *sorted = frame_stats.items;
+    size_t n = frame_stats.count;
+    qsort(sorted, n, sizeof(*sorted), compare_doubles);
+    printf("[LOG] frame time over %zu frames: p50 %.2fms, p90 %.2fms, p99 %.2fms, max %.2fms\n",
+           n, sorted[n*50/100], sorted[n*90/100], sorted[n*99/100], sorted[n - 1]);
+    frame_stats.count = 0;
+}
+
+// Input latency of the turns: from the key event to the game_update() that changed the direction
+// and to the SDL_RenderPresent() of the first frame that shows it
+#define LATENCY_STATS_WINDOW 32
+
+typedef struct {
+    double consumed[LATENCY_STATS_WINDOW];
+    double presented[LATENCY_STATS_WINDOW];
+    size_t count;
+} Latency_Stats;
+
+static Latency_Stats latency_stats = {0};
+
+void latency_stats_report(void)
+{
+    size_t n = latency_stats.count;
+    if (n == 0) return;
+    qsort(latency_stats.consumed, n, sizeof(double), compare_doubles);
+    qsort(latency_stats.presented, n, sizeof(double), compare_doubles);
+    printf("[LOG] input latency over %zu turns: consumed p50 %.1fms, p99 %.1fms, max %.1fms; presented p50 %.1fms, p90 %.1fms, p99 %.1fms, max %.1fms\n",
+           n,
+           latency_stats.consumed[n*50/100], latency_stats.consumed[n*99/100], latency_stats.consumed[n - 1],
+           latency_stats.presented[n*50/100], latency_stats.presented[n*90/100], latency_stats.presented[n*99/100], latency_stats.presented[n - 1]);
+    latency_stats.count = 0;
+}
+
+void latency_stats_push(Latency_Sample sample, double presented)
+{
+    latency_stats.consumed[latency_stats.count] = (sample.consume_time - sample.input_time)*1000.0;
+    latency_stats.presented[latency_stats.count] = (presented - sample.input_time)*1000.0;
+    latency_stats.count += 1;
+    if (latency_stats.count >= LATENCY_STATS_WINDOW) latency_stats_report();
+}
+
+static atomic_bool running = true;
+
+int simulation_thread(void *data)
+{
+    (void) data;
+
+    double skipped = 0.0; // seconds the simulation did not see because of FRAME_MAX_DT
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 period = freq/TARGET_FPS;
+    Uint64 prev = SDL_GetPerformanceCounter();
+    Uint64 next_frame = prev + period;
+    bool dropped = false;
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        Host_Event event;
+        while (host_event_pop(&event)) {
+            switch (event.kind) {
+            case HOST_EVENT_KEY:
+                game_input(event.time - skipped, event.key);
+                break;
+            case HOST_EVENT_RESIZE:
+                game_resize(event.width, event.height);
+                break;
+            }
+        }
+
+        Uint64 now = SDL_GetPerformanceCounter();
+        double dt = (double) (now - prev)/freq;
+        if (dt > FRAME_MAX_DT) {
+            skipped += dt - FRAME_MAX_DT;
+            dt = FRAME_MAX_DT;
+        }
+        prev = now;
+
+        game_update(dt);
+        Snapshot *snapshot = snapshot_back();
+        arrsetlen(snapshot->commands, 0);
+        arrsetlen(snapshot->text, 0);
+        // NOTE: the turns of a snapshot that was never presented are first shown by this one
+        if (!dropped) arrsetlen(snapshot->latencies, 0);
+        game_render();
+
+        Latency_Ring *latencies = game_latency_ring();
+        for (u32 i = 0; i < latencies->size; ++i) {
+            Latency_Sample sample = latencies->items[(latencies->begin + i)%LATENCY_RING_CAP];
+            sample.input_time += skipped;
+            sample.consume_time += skipped;
+            arrput(snapshot->latencies, sample);
+        }
+        latencies->size = 0;
+
+        dropped = snapshot_publish();
+        game_log_flush();
+
+        frame_wait_until(next_frame);
+        next_frame += period;
+        now = SDL_GetPerformanceCounter();
+        // NOTE: if we fell behind, start pacing from now instead of rushing the missed frames
+        if (now > next_frame) next_frame = now;
+    }
+    return 0;
+}
+
+// Writes the recording started with --record, see game_record_begin() in game.h
+static void record_save(const char *file_path)
+{
+    u32 size = game_record_end();
+    if (size == 0) {
+        fprintf(stderr, "[LOG] the recording does not fit into %u bytes\n", REPLAY_CAP);
+        return;
+    }
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "[LOG] could not open %s\n", file_path);
+        return;
+    }
+    fwrite(game_replay_buffer(), 1, size, f);
+    fclose(f);
+    printf("[LOG] recording: %s (%u bytes)\n", file_path, size);
+}
+
+int main(int argc, char **argv)
+{
+    bool vsync = false;
+    const char *record_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--vsync") == 0) {
+            vsync = true;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--vsync] [--record FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
     game_init(WIDTH, HEIGHT);
+    if (record_path != NULL) game_record_begin();
 
     scc(SDL_Init(SDL_INIT_VIDEO));
     scc(TTF_Init());
+    ttf_mutex = scp(SDL_CreateMutex());
     window = scp(SDL_CreateWindow(
                      "Snake Native SDL",
                      0, 0,
@@ -170,29 +688,47 @@ int main()
     renderer = scp(SDL_CreateRenderer(
                        window,
                        -1,
-                       SDL_RENDERER_ACCELERATED));
+                       SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0)));
 
     scc(SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND));
 
-    bool quit = false;
-    while (!quit) {
+    // NOTE: the input clock starts here, see Input_Event in game.h. The SDL event timestamps are in
+    // SDL_GetTicks() milliseconds, the frames are measured with the performance counter.
+    Uint32 origin = SDL_GetTicks();
+    SDL_Thread *simulation = scp(SDL_CreateThread(simulation_thread, "simulation", NULL));
+
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 period = freq/TARGET_FPS;
+    Uint64 prev = SDL_GetPerformanceCounter();
+    Uint64 next_frame = prev + period;
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             switch (event.type) {
             case SDL_QUIT: {
-                quit = true;
+                atomic_store_explicit(&running, false, memory_order_relaxed);
             }
             break;
 
             case SDL_KEYDOWN: {
-                game_keydown(event.key.keysym.sym);
+                Host_Event key = {
+                    .kind = HOST_EVENT_KEY,
+                    .time = (event.key.timestamp - origin)*0.001,
+                    .key = event.key.keysym.sym,
+                };
+                if (!host_event_push(key)) printf("[LOG] event queue is full, dropped a key\n");
             }
             break;
 
             case SDL_WINDOWEVENT: {
                 switch (event.window.event) {
                 case SDL_WINDOWEVENT_RESIZED: {
-                    game_resize(event.window.data1, event.window.data2);
+                    Host_Event resize = {
+                        .kind = HOST_EVENT_RESIZE,
+                        .width = event.window.data1,
+                        .height = event.window.data2,
+                    };
+                    if (!host_event_push(resize)) printf("[LOG] event queue is full, dropped a resize\n");
                 }
                 break;
                 }
@@ -200,15 +736,35 @@ int main()
             }
         }
 
+        Uint64 now = SDL_GetPerformanceCounter();
+        frame_stats_push((double) (now - prev)*1000.0/freq);
+        prev = now;
+
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
         SDL_RenderClear(renderer);
-        game_update(1.0f/60.0f);
-        game_render();
-        // TODO: better way to lock 60 FPS
+        Snapshot *snapshot = snapshot_latest();
+        snapshot_render(snapshot);
         SDL_RenderPresent(renderer);
-        SDL_Delay(1000/60);
+
+        double presented = (SDL_GetTicks() - origin)*0.001;
+        for (ptrdiff_t i = 0; i < arrlen(snapshot->latencies); ++i) {
+            latency_stats_push(snapshot->latencies[i], presented);
+        }
+        arrsetlen(snapshot->latencies, 0);
+
+        if (!vsync) {
+            frame_wait_until(next_frame);
+            next_frame += period;
+            now = SDL_GetPerformanceCounter();
+            if (now > next_frame) next_frame = now;
+        }
     }
 
+    SDL_WaitThread(simulation, NULL);
+
+    if (record_path != NULL) record_save(record_path);
+    latency_stats_report();
+
     TTF_Quit();
     SDL_Quit();
 
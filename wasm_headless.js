@@ -0,0 +1,284 @@
+'use strict';
+
+// Runs game.wasm without a browser and reports how long the exported entry points take:
+//   $ node wasm_headless.js [--wasm game.wasm] [--frames 3600] [--dt 0.016666] [--size 1600x900] [--trace trace.json] [--record session.rec] [input.txt]
+//   $ node wasm_headless.js [--wasm game.wasm] --replay session.rec [--seek TICK] [--hash-trace hashes.txt]
+//
+// The input file has one event per line: `<frame> <key>` where <key> is a single character or
+// `space`. Lines starting with # are ignored. The keys of a frame are delivered right before
+// that frame's game_update().
+//
+// --trace dumps the trace zones recorded by a module built with FEATURE_TRACE (game.dev.wasm) as
+// Chrome trace JSON, the same format headless_main produces.
+//
+// --record and --replay write and play back recordings of the game (see game_record_begin() in
+// game.h) the same way headless_main does, so a session recorded by either runs on both.
+// --hash-trace writes the same per-tick state hashes as headless_main, see hash_diff.js.
+
+const fs = require('fs');
+const { log_flush } = require('./log_ring.js');
+
+function usage() {
+    console.error("Usage: node wasm_headless.js [--wasm game.wasm] [--frames N] [--dt SECONDS] [--size WxH] [--trace FILE] [--record FILE] [input.txt]");
+    console.error("       node wasm_headless.js [--wasm game.wasm] --replay FILE [--seek TICK] [--hash-trace FILE]");
+    process.exit(1);
+}
+
+function parse_args(argv) {
+    const args = {
+        wasm: 'game.wasm',
+        frames: 3600,
+        dt: 1/60,
+        width: 1600,
+        height: 900,
+        input: null,
+        trace: null,
+        record: null,
+        replay: null,
+        seek: null,
+        hash_trace: null,
+    };
+    for (let i = 0; i < argv.length; ++i) {
+        switch (argv[i]) {
+        case '--wasm':   args.wasm = argv[++i]; break;
+        case '--frames': args.frames = parseInt(argv[++i]); break;
+        case '--dt':     args.dt = parseFloat(argv[++i]); break;
+        case '--trace':  args.trace = argv[++i]; break;
+        case '--record': args.record = argv[++i]; break;
+        case '--replay': args.replay = argv[++i]; break;
+        case '--seek':   args.seek = parseInt(argv[++i]); break;
+        case '--hash-trace': args.hash_trace = argv[++i]; break;
+        case '--size': {
+            const [w, h] = (argv[++i] || '').split('x').map((x) => parseInt(x));
+            if (!(w > 0 && h > 0)) usage();
+            args.width = w;
+            args.height = h;
+        } break;
+        default:
+            if (argv[i].startsWith('--') || args.input !== null) usage();
+            args.input = argv[i];
+        }
+    }
+    if (!(args.frames > 0 && args.dt > 0)) usage();
+    if (args.seek !== null && !(args.seek >= 0 && args.replay !== null)) usage();
+    if (args.hash_trace !== null && args.replay === null) usage();
+    return args;
+}
+
+function parse_input(file_path) {
+    const events = new Map();
+    const lines = fs.readFileSync(file_path, 'utf8').split('\n');
+    lines.forEach((line, index) => {
+        line = line.trim();
+        if (line.length == 0 || line.startsWith('#')) return;
+        const [frame_str, key_str] = line.split(/\s+/);
+        const frame = parseInt(frame_str);
+        const key = key_str === 'space' ? ' ' : key_str;
+        if (!(frame >= 0) || key === undefined || key.length != 1) {
+            throw new Error(`${file_path}:${index + 1}: expected \`<frame> <key>\``);
+        }
+        if (!events.has(frame)) events.set(frame, []);
+        events.get(frame).push(key.charCodeAt());
+    });
+    return events;
+}
+
+function cstr_by_ptr(mem_buffer, ptr) {
+    const mem = new Uint8Array(mem_buffer);
+    let len = 0;
+    while (mem[ptr + len] != 0) len++;
+    return new TextDecoder().decode(new Uint8Array(mem_buffer, ptr, len));
+}
+
+function instantiate(file_path, calls) {
+    let exports = null;
+    const count = (name, f) => (...args) => {
+        calls[name] = (calls[name] || 0) + 1;
+        return f(...args);
+    };
+    const module = new WebAssembly.Module(fs.readFileSync(file_path));
+    const env = {
+        platform_fill_rect:   () => {},
+        platform_stroke_rect: () => {},
+        platform_fill_text:   () => {},
+        // NOTE: a fixed advance per character, the same one the native headless platform uses
+        platform_text_width:  (text_ptr, size) => cstr_by_ptr(exports.memory.buffer, text_ptr).length*size/2 | 0,
+        platform_log:         (message_ptr) => console.log(cstr_by_ptr(exports.memory.buffer, message_ptr)),
+        platform_now_ns:      () => process.hrtime.bigint(),
+        platform_panic:       (file_path_ptr, line, message_ptr) => {
+            const buffer = exports.memory.buffer;
+            throw new Error(`${cstr_by_ptr(buffer, file_path_ptr)}:${line}: GAME ASSERTION FAILED: ${cstr_by_ptr(buffer, message_ptr)}`);
+        },
+    };
+    // Stub any import this runner does not know about yet so newer modules still instantiate
+    for (const imp of WebAssembly.Module.imports(module)) {
+        if (imp.kind === 'function' && !(imp.name in env)) env[imp.name] = () => 0;
+    }
+    for (const name in env) env[name] = count(name, env[name]);
+    exports = new WebAssembly.Instance(module, { env }).exports;
+    return exports;
+}
+
+// Layout of Trace_Ring and Trace_Zone from game.h on wasm32
+const TRACE_RING_CAP = 4096;
+const TRACE_RING_ITEMS_OFFSET = 8;
+const TRACE_ZONE_SIZE = 24;
+
+function trace_dump(game, file_path) {
+    const ring = game.game_trace_ring ? game.game_trace_ring() : 0;
+    if (ring == 0) {
+        throw new Error(`${args.wasm} is compiled without FEATURE_TRACE`);
+    }
+    const buffer = game.memory.buffer;
+    const view = new DataView(buffer);
+    const begin = view.getUint32(ring + 0, true);
+    const size = view.getUint32(ring + 4, true);
+    const zones = [];
+    for (let i = 0; i < size; ++i) {
+        const zone = ring + TRACE_RING_ITEMS_OFFSET + ((begin + i)%TRACE_RING_CAP)*TRACE_ZONE_SIZE;
+        zones.push({
+            begin_ns: view.getBigUint64(zone + 0, true),
+            end_ns:   view.getBigUint64(zone + 8, true),
+            name:     cstr_by_ptr(buffer, view.getUint32(zone + 16, true)),
+            depth:    view.getUint32(zone + 20, true),
+        });
+    }
+    // NOTE: zones are recorded when they end, the earliest one is not necessarily the first
+    const origin = zones.reduce((a, z) => z.begin_ns < a ? z.begin_ns : a, zones.length > 0 ? zones[0].begin_ns : 0n);
+    const events = zones.map((z) => ({
+        name: z.name,
+        ph: 'X',
+        ts: Number(z.begin_ns - origin)/1000,
+        dur: Number(z.end_ns - z.begin_ns)/1000,
+        pid: 0,
+        tid: 0,
+        args: {depth: z.depth},
+    }));
+    fs.writeFileSync(file_path, JSON.stringify({traceEvents: events, displayTimeUnit: 'ns'}));
+    console.log(`trace: ${file_path} (${zones.length} zones)`);
+}
+
+function percentile(sorted, p) {
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length*p))];
+}
+
+function stats(samples) {
+    const sorted = Float64Array.from(samples).sort();
+    const mean = sorted.reduce((a, b) => a + b, 0)/sorted.length;
+    return `mean ${mean.toFixed(0).padStart(7)} ns  p50 ${percentile(sorted, 0.5).toFixed(0).padStart(7)} ns  p99 ${percentile(sorted, 0.99).toFixed(0).padStart(7)} ns`;
+}
+
+// NOTE: an older module may lack the exports of the newer features, fail with a clear message
+function require_exports(game, names) {
+    const missing = names.filter((name) => !game[name]);
+    if (missing.length > 0) {
+        throw new Error(`${args.wasm} does not export ${missing.join(', ')}, rebuild it with ./build.sh`);
+    }
+}
+
+function record_save(game, file_path) {
+    const size = game.game_record_end();
+    if (size == 0) throw new Error(`the recording does not fit into the replay buffer`);
+    fs.writeFileSync(file_path, new Uint8Array(game.memory.buffer, game.game_replay_buffer(), size));
+    console.log(`record: ${file_path} (${size} bytes)`);
+}
+
+// Plays the recording back at maximum speed, one tick after another, from the given tick if any
+function replay_run(game, file_path, seek, hash_trace_path) {
+    const bytes = fs.readFileSync(file_path);
+    new Uint8Array(game.memory.buffer, game.game_replay_buffer(), bytes.length).set(bytes);
+    if (!game.game_replay_begin(bytes.length)) throw new Error(`${file_path} is not a recording`);
+    if (seek !== null) {
+        const start = process.hrtime.bigint();
+        if (!game.game_replay_seek(seek)) throw new Error(`could not seek ${file_path} to tick ${seek}`);
+        console.log(`seek: tick ${seek} in ${process.hrtime.bigint() - start} ns`);
+    }
+
+    // NOTE: u64 exports return a BigInt
+    const hashes = [];
+    const hash_trace = () => {
+        if (hash_trace_path !== null) hashes.push(`${game.game_replay_tick()} ${BigInt.asUintN(64, game.game_replay_hash()).toString(16).padStart(16, '0')}\n`);
+    };
+    hash_trace();
+
+    let ticks = 0;
+    const start = process.hrtime.bigint();
+    for (;;) {
+        const more = game.game_replay_step();
+        game.game_render();
+        log_flush(game, console.log);
+        if (!more) break;
+        hash_trace();
+        ticks += 1;
+    }
+    const ns = Number(process.hrtime.bigint() - start);
+    if (hash_trace_path !== null) {
+        fs.writeFileSync(hash_trace_path, hashes.join(''));
+        console.log(`hash trace: ${hash_trace_path}`);
+    }
+    console.log(`replay: ${file_path}, ${ticks} ticks, ${(ns/Math.max(ticks, 1)).toFixed(0)} ns per tick`);
+    if (!game.game_replay_verify()) {
+        console.error(`ERROR: the replay diverged from the recording`);
+        process.exit(1);
+    }
+    console.log(`replay: OK`);
+}
+
+const args = parse_args(process.argv.slice(2));
+const events = args.input !== null ? parse_input(args.input) : new Map();
+const calls = {};
+const game = instantiate(args.wasm, calls);
+
+// NOTE: hrtime itself is not free, subtract its cost from every sample
+let timer_overhead = Infinity;
+for (let i = 0; i < 1000; ++i) {
+    const a = process.hrtime.bigint();
+    const b = process.hrtime.bigint();
+    timer_overhead = Math.min(timer_overhead, Number(b - a));
+}
+
+game.game_init(args.width, args.height);
+if (args.replay !== null) {
+    require_exports(game, ['game_replay_buffer', 'game_replay_begin', 'game_replay_seek', 'game_replay_step', 'game_replay_verify']);
+    if (args.hash_trace !== null) require_exports(game, ['game_replay_tick', 'game_replay_hash']);
+    replay_run(game, args.replay, args.seek, args.hash_trace);
+    process.exit(0);
+}
+if (args.record !== null) {
+    require_exports(game, ['game_record_begin', 'game_record_end', 'game_replay_buffer']);
+    game.game_record_begin();
+}
+for (const name in calls) calls[name] = 0;
+
+const update_ns = new Float64Array(args.frames);
+const render_ns = new Float64Array(args.frames);
+for (let frame = 0; frame < args.frames; ++frame) {
+    for (const key of events.get(frame) || []) {
+        if (game.game_input) {
+            game.game_input(frame*args.dt, key);
+        } else {
+            game.game_keydown(key);
+        }
+    }
+
+    const t0 = process.hrtime.bigint();
+    game.game_update(args.dt);
+    const t1 = process.hrtime.bigint();
+    game.game_render();
+    const t2 = process.hrtime.bigint();
+
+    update_ns[frame] = Math.max(0, Number(t1 - t0) - timer_overhead);
+    render_ns[frame] = Math.max(0, Number(t2 - t1) - timer_overhead);
+
+    log_flush(game, console.log);
+}
+
+console.log(`${args.wasm}: ${args.frames} frames at ${args.width}x${args.height}, dt = ${args.dt}`);
+console.log(`game_update  ${stats(update_ns)}`);
+console.log(`game_render  ${stats(render_ns)}`);
+console.log(`imports per frame:`);
+for (const name of Object.keys(calls).sort()) {
+    console.log(`    ${name.padEnd(24)} ${(calls[name]/args.frames).toFixed(2)}`);
+}
+if (args.trace !== null) trace_dump(game, args.trace);
+if (args.record !== null) record_save(game, args.record);
@@ -29,12 +29,90 @@ function color_hex(color) {
     return "#"+r+g+b+a;
 }
 
+// Opaque rects are accumulated into one Path2D per color and filled once per color. A batch never
+// contains overlapping rects of different colors (it is flushed before that happens), so the order
+// the colors are filled in does not matter and the picture is identical to drawing rect by rect.
+// Disable with ?batch=0 to compare.
+const BATCH_RECTS = new URLSearchParams(window.location.search).get('batch') !== '0';
+const BATCH_TILE_SIZE = 128;
+const batch_paths = new Map(); // color -> Path2D
+const batch_tiles = new Map(); // tile -> [x, y, w, h, color, ...] of the rects touching the tile
+
+function batch_tile_key(tx, ty) {
+    return (tx&0xFFFF) | ((ty&0xFFFF)<<16);
+}
+
+function batch_for_each_tile(x, y, w, h, f) {
+    const tx1 = Math.floor(x/BATCH_TILE_SIZE);
+    const ty1 = Math.floor(y/BATCH_TILE_SIZE);
+    const tx2 = Math.floor((x + w - 1)/BATCH_TILE_SIZE);
+    const ty2 = Math.floor((y + h - 1)/BATCH_TILE_SIZE);
+    for (let ty = ty1; ty <= ty2; ++ty) {
+        for (let tx = tx1; tx <= tx2; ++tx) {
+            if (f(batch_tile_key(tx, ty))) return true;
+        }
+    }
+    return false;
+}
+
+function batch_overlaps_other_color(x, y, w, h, color) {
+    return batch_for_each_tile(x, y, w, h, (key) => {
+        const rects = batch_tiles.get(key);
+        if (rects === undefined) return false;
+        for (let i = 0; i < rects.length; i += 5) {
+            if (rects[i + 4] !== color &&
+                x < rects[i] + rects[i + 2] && rects[i] < x + w &&
+                y < rects[i + 1] + rects[i + 3] && rects[i + 1] < y + h) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+function batch_flush() {
+    for (const [color, path] of batch_paths) {
+        ctx.fillStyle = color_hex(color);
+        ctx.fill(path);
+    }
+    batch_paths.clear();
+    batch_tiles.clear();
+}
+
 function platform_fill_rect(x, y, w, h, color) {
-    ctx.fillStyle = color_hex(color); 
-    ctx.fillRect(x, y, w, h);
+    if (!BATCH_RECTS || (color>>>24) !== 0xFF) {
+        batch_flush();
+        ctx.fillStyle = color_hex(color);
+        ctx.fillRect(x, y, w, h);
+        return;
+    }
+
+    // NOTE: a negative size would add a subpath with the opposite winding and punch a hole into the batch
+    if (w < 0) { x += w; w = -w; }
+    if (h < 0) { y += h; h = -h; }
+    if (w === 0 || h === 0) return;
+
+    if (batch_overlaps_other_color(x, y, w, h, color)) batch_flush();
+
+    let path = batch_paths.get(color);
+    if (path === undefined) {
+        path = new Path2D();
+        batch_paths.set(color, path);
+    }
+    path.rect(x, y, w, h);
+    batch_for_each_tile(x, y, w, h, (key) => {
+        let rects = batch_tiles.get(key);
+        if (rects === undefined) {
+            rects = [];
+            batch_tiles.set(key, rects);
+        }
+        rects.push(x, y, w, h, color);
+        return false;
+    });
 }
 
 function platform_stroke_rect(x, y, w, h, color) {
+    batch_flush();
     ctx.strokeStyle = color_hex(color); 
     ctx.strokeRect(x, y, w, h);
 }
@@ -49,6 +127,7 @@ function platform_text_width(text_ptr, size) {
 function platform_fill_text(x, y, text_ptr, size, color) {
     const buffer = wasm.instance.exports.memory.buffer;
     const text = cstr_by_ptr(buffer, text_ptr);
+    batch_flush();
     ctx.fillStyle = color_hex(color);
     ctx.font = size+"px AnekLatin";
     ctx.fillText(text, x, y);
@@ -68,6 +147,88 @@ function platform_log(message_ptr) {
     console.log(message);
 }
 
+function platform_now_ns() {
+    // NOTE: u64 imports take a BigInt
+    return BigInt(Math.round(performance.now()*1e6));
+}
+
+// Layout of Input_Ring from game.h
+const INPUT_RING_CAP = 64;
+const INPUT_RING_ITEMS_OFFSET = 8;
+const INPUT_EVENT_SIZE = 16;
+
+// See game_update() in game.h, the game clock then runs behind the timestamps by `skipped` seconds
+const FRAME_MAX_DT = 0.25;
+let skipped = 0;
+
+let origin = null;
+function game_input(timestamp, key) {
+    const exports = wasm.instance.exports;
+    const time = origin === null ? 0 : (timestamp - origin)*0.001 - skipped;
+    // NOTE: an older game.wasm has no input ring, the keys then go in without timestamps
+    if (!exports.game_input_ring) {
+        exports.game_keydown(key);
+        return;
+    }
+    const ring = exports.game_input_ring();
+    const view = new DataView(exports.memory.buffer);
+    const begin = view.getUint32(ring + 0, true);
+    const size = view.getUint32(ring + 4, true);
+    if (size >= INPUT_RING_CAP) {
+        exports.game_input(time, key);
+        return;
+    }
+    const item = ring + INPUT_RING_ITEMS_OFFSET + ((begin + size)%INPUT_RING_CAP)*INPUT_EVENT_SIZE;
+    view.setFloat64(item + 0, time, true);
+    view.setInt32(item + 8, key, true);
+    view.setUint32(ring + 4, size + 1, true);
+}
+
+// Layout of Latency_Ring from game.h
+const LATENCY_RING_CAP = 16;
+const LATENCY_RING_ITEMS_OFFSET = 8;
+const LATENCY_SAMPLE_SIZE = 16;
+const LATENCY_STATS_WINDOW = 32;
+
+// Turns rendered by the last game_render(), they are on the screen by the next requestAnimationFrame()
+let latency_pending = [];
+let latency_consumed = [];
+let latency_presented = [];
+
+function latency_take_rendered() {
+    const exports = wasm.instance.exports;
+    if (!exports.game_latency_ring) return;
+    const ring = exports.game_latency_ring();
+    const view = new DataView(exports.memory.buffer);
+    const begin = view.getUint32(ring + 0, true);
+    const size = view.getUint32(ring + 4, true);
+    for (let i = 0; i < size; ++i) {
+        const item = ring + LATENCY_RING_ITEMS_OFFSET + ((begin + i)%LATENCY_RING_CAP)*LATENCY_SAMPLE_SIZE;
+        latency_pending.push({
+            input_time: view.getFloat64(item + 0, true),
+            consume_time: view.getFloat64(item + 8, true),
+        });
+    }
+    view.setUint32(ring + 4, 0, true);
+}
+
+function latency_presented_at(timestamp) {
+    const presented = (timestamp - origin)*0.001 - skipped;
+    for (const sample of latency_pending) {
+        latency_consumed.push((sample.consume_time - sample.input_time)*1000);
+        latency_presented.push((presented - sample.input_time)*1000);
+    }
+    latency_pending = [];
+    if (latency_consumed.length >= LATENCY_STATS_WINDOW) {
+        const p = (xs, q) => xs[Math.floor(xs.length*q)].toFixed(1);
+        const c = latency_consumed.sort((a, b) => a - b);
+        const s = latency_presented.sort((a, b) => a - b);
+        console.log(`input latency over ${c.length} turns: consumed p50 ${p(c, 0.5)}ms, p99 ${p(c, 0.99)}ms, max ${c[c.length - 1].toFixed(1)}ms; presented p50 ${p(s, 0.5)}ms, p90 ${p(s, 0.9)}ms, p99 ${p(s, 0.99)}ms, max ${s[s.length - 1].toFixed(1)}ms`);
+        latency_consumed = [];
+        latency_presented = [];
+    }
+}
+
 let prev = null;
 let touchStartX = null;
 let touchStartY = null;
@@ -76,16 +237,59 @@ let touchEndY = null;
 let touchStartTimestamp = null;
 function loop(timestamp) {
     if (prev !== null) {
-        wasm.instance.exports.game_update((timestamp - prev)*0.001);
+        latency_presented_at(timestamp);
+        let dt = (timestamp - prev)*0.001;
+        if (dt > FRAME_MAX_DT) {
+            skipped += dt - FRAME_MAX_DT;
+            dt = FRAME_MAX_DT;
+        }
+        wasm.instance.exports.game_update(dt);
         wasm.instance.exports.game_render();
+        batch_flush();
+        latency_take_rendered();
+        log_flush(wasm.instance.exports, console.log);
+    } else {
+        origin = timestamp;
     }
     prev = timestamp;
     window.requestAnimationFrame(loop);
 }
 
+// ?record starts a recording of the session (see game_record_begin() in game.h), Escape ends it and
+// downloads it for `./headless_main --replay`.
+let RECORD = new URLSearchParams(window.location.search).has('record');
+
+function record_save() {
+    const exports = wasm.instance.exports;
+    const size = exports.game_record_end();
+    if (size == 0) {
+        console.warn("The recording is too big or has already been saved");
+        return;
+    }
+    const bytes = new Uint8Array(exports.memory.buffer, exports.game_replay_buffer(), size).slice();
+    const link = document.createElement('a');
+    link.href = URL.createObjectURL(new Blob([bytes], {type: 'application/octet-stream'}));
+    link.download = 'snake.rec';
+    link.click();
+    URL.revokeObjectURL(link.href);
+}
+
 function mod(a, b) { return (a%b + b)%b }
 
-WebAssembly.instantiateStreaming(fetch('game.wasm'), {
+// Smallest module that uses a SIMD128 instruction (i8x16.popcnt)
+const SIMD_PROBE = new Uint8Array([0,97,115,109,1,0,0,0,1,5,1,96,0,1,123,3,2,1,0,10,10,1,8,0,65,0,253,15,253,98,11]);
+
+function instantiate_game(imports) {
+    if (!WebAssembly.validate(SIMD_PROBE)) {
+        return WebAssembly.instantiateStreaming(fetch('game.wasm'), imports);
+    }
+    return WebAssembly.instantiateStreaming(fetch('game.simd.wasm'), imports).catch((e) => {
+        console.warn("Could not load game.simd.wasm, falling back to game.wasm:", e);
+        return WebAssembly.instantiateStreaming(fetch('game.wasm'), imports);
+    });
+}
+
+instantiate_game({
     env: {
         platform_fill_rect,
         platform_stroke_rect,
@@ -93,14 +297,24 @@ WebAssembly.instantiateStreaming(fetch('game.wasm'), {
         platform_panic,
         platform_log,
         platform_text_width,
+        platform_now_ns,
     }
 }).then((w) => {
     wasm = w;
 
     wasm.instance.exports.game_init(app.width, app.height);
+    if (RECORD && !wasm.instance.exports.game_record_begin) {
+        console.warn("This game.wasm can not record, rebuild it with ./build.sh");
+        RECORD = false;
+    }
+    if (RECORD) wasm.instance.exports.game_record_begin();
 
     document.addEventListener('keydown', (e) => {
-        wasm.instance.exports.game_keydown(e.key.charCodeAt());
+        if (RECORD && e.key === 'Escape') {
+            record_save();
+            return;
+        }
+        game_input(e.timeStamp, e.key.charCodeAt());
     });
 
     document.addEventListener("touchstart", (e) => {
@@ -123,13 +337,13 @@ WebAssembly.instantiateStreaming(fetch('game.wasm'), {
         if (intensity > THRESHOLD) {
             const QOP = Math.PI/4; // Quater of Pee
             if ((0*QOP <= angle && angle < 1*QOP) || (7*QOP <= angle && angle < 8*QOP)) {
-                wasm.instance.exports.game_keydown('d'.charCodeAt());
+                game_input(e.timeStamp, 'd'.charCodeAt());
             } else if (1*QOP <= angle && angle < 3*QOP) {
-                wasm.instance.exports.game_keydown('s'.charCodeAt());
+                game_input(e.timeStamp, 's'.charCodeAt());
             } else if (3*QOP <= angle && angle < 5*QOP) {
-                wasm.instance.exports.game_keydown('a'.charCodeAt());
+                game_input(e.timeStamp, 'a'.charCodeAt());
             } else if (5*QOP <= angle && angle < 7*QOP) {
-                wasm.instance.exports.game_keydown('w'.charCodeAt());
+                game_input(e.timeStamp, 'w'.charCodeAt());
             }
         }
     }, false);